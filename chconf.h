@@ -487,8 +487,11 @@
  * @details This hook is invoked just before switching between threads.
  */
 #if !defined(THREAD_CONTEXT_SWITCH_HOOK) || defined(__DOXYGEN__)
+#if !defined(_FROM_ASM_)
+void traceSwitch(void *ntp, void *otp);     /* myTrace.c                    */
+#endif
 #define THREAD_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
-  /* System halt code here.*/                                               \
+  traceSwitch(ntp, otp);                                                    \
 }
 #endif
 
@@ -519,8 +522,11 @@
  *          the system is halted.
  */
 #if !defined(SYSTEM_HALT_HOOK) || defined(__DOXYGEN__)
+#if !defined(_FROM_ASM_)
+void recPanic(void);                        /* myRec.c                      */
+#endif
 #define SYSTEM_HALT_HOOK() {                                                \
-  /* System halt code here.*/                                               \
+  recPanic();                                                               \
 }
 #endif
 
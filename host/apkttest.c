@@ -0,0 +1,110 @@
+/*
+ * Test of the audio packetizer (myAudioPkt.c) with the real burst pattern
+ * of the continuous conversion: a half buffer of pushes at once, one
+ * packet per 1 ms frame.
+ *
+ *   gcc -O2 -Wall -I. -o apkttest host/apkttest.c myAudioPkt.c
+ *   ./apkttest
+ *
+ * Or run all host tests with make -C host test. Exits with 1 on failure.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "myAudioPkt.h"
+
+/*
+ * As on the board: 84 MHz / 4 / (8 * 492) is 5335.37 Hz, the firmware
+ * announces the integer part, and a half buffer holds 512 sequences
+ */
+#define RATE            5335
+#define BURST           512
+#define SECONDS         600
+#define WARMUP          2
+
+static ApktState ap;
+static int16_t out[APKT_MAX_SAMPLES(RATE)];
+
+/*
+ * Runs the ADC at realRate for SECONDS, returns the number of failures
+ */
+static int run(double realRate) {
+  double nextBurst = BURST / realRate;
+  uint64_t pushed = 0, taken = 0, pushedStart = 0, takenStart = 0;
+  uint32_t level, minLevel = APKT_FIFO_SIZE, maxLevel = 0, n;
+  uint32_t band = BURST / 2 + APKT_FIFO_MARGIN;
+  uint32_t frame, i;
+  int16_t sample = 0;
+  double inRate, outRate;
+  int failures = 0;
+
+  apktInit(&ap, RATE, BURST);
+  for (frame = 0; frame < SECONDS * 1000; frame++) {
+    /* every half buffer that filled up before this frame */
+    while (nextBurst <= frame / 1000.0) {
+      for (i = 0; i < BURST; i++)
+        apktPush(&ap, sample++);
+      pushed += BURST;
+      nextBurst += BURST / realRate;
+    }
+    if (frame == WARMUP * 1000) {
+      ap.underruns = 0;
+      ap.longer = 0;
+      ap.shorter = 0;
+      pushedStart = pushed;
+      takenStart = taken;
+    }
+    n = apktFill(&ap, out);
+    if (n > APKT_MAX_SAMPLES(RATE)) {
+      printf("%.2f Hz: packet of %u samples\n", realRate, n);
+      failures++;
+    }
+    taken += n;
+    level = apktLevel(&ap);
+    if (frame >= WARMUP * 1000) {
+      if (level < minLevel)
+        minLevel = level;
+      if (level > maxLevel)
+        maxLevel = level;
+    }
+  }
+
+  inRate = (double)(pushed - pushedStart) / (SECONDS - WARMUP);
+  outRate = (double)(taken - takenStart) / (SECONDS - WARMUP);
+  printf("%.2f Hz: out %.2f Hz, level %u..%u, +%u -%u, %u underruns, "
+         "%u overruns\n", realRate, outRate, minLevel, maxLevel, ap.longer,
+         ap.shorter, ap.underruns, ap.overruns);
+
+  /* the level saws by a burst inside the band around one burst, the low
+     end give or take the samples of two packets */
+  if (maxLevel > BURST + band ||
+      minLevel + band + 2 * APKT_MAX_SAMPLES(RATE) < BURST) {
+    printf("%.2f Hz: level not bounded\n", realRate);
+    failures++;
+  }
+  if (ap.underruns || ap.overruns) {
+    printf("%.2f Hz: lost samples\n", realRate);
+    failures++;
+  }
+  /* the rates may differ by one FIFO over the run */
+  if (outRate < inRate - (double)APKT_FIFO_SIZE / (SECONDS - WARMUP) ||
+      outRate > inRate + (double)APKT_FIFO_SIZE / (SECONDS - WARMUP) ||
+      outRate < realRate * 0.9999 || outRate > realRate * 1.0001) {
+    printf("%.2f Hz: wrong output rate\n", realRate);
+    failures++;
+  }
+  return failures;
+}
+
+int main(void) {
+  int failures = 0;
+
+  failures += run(84e6 / 4 / (8 * 492));
+  failures += run(RATE);
+  failures += run(RATE * 1.001);
+  failures += run(RATE * 0.999);
+  printf("apkttest: %s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
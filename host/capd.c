@@ -0,0 +1,217 @@
+/*
+ * Capture daemon for the raw sample stream.
+ *
+ *   gcc -O2 -Wall -I. -o capd host/capd.c host/capfile.c
+ *   ./capd /dev/ttyACM0 /dev/ttyUSB0 out.cap [seconds]
+ *
+ * Switches the stream on over the shell ("raw on", "mc"), writes every
+ * packet from the data channel to a capture file (format in capfile.h)
+ * until the time is up or it gets SIGINT/SIGTERM, then switches the
+ * stream off again ("raw off", "sc") and adds the seek index. Half
+ * buffers the device had to drop show up as gaps in seq, they are
+ * counted and reported.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/capfile.h"
+
+static int con;
+static volatile sig_atomic_t stop;
+
+static void die(const char *what) {
+
+  perror(what);
+  exit(1);
+}
+
+static void writeAll(int f, const void *buf, size_t n) {
+  const uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t w = write(f, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      die("write");
+    }
+    p += w;
+    n -= w;
+  }
+}
+
+static void readAll(int f, void *buf, size_t n) {
+  uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t r = read(f, p, n);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      die("read");
+    }
+    if (r == 0) {
+      fprintf(stderr, "timeout\n");
+      exit(1);
+    }
+    p += r;
+    n -= r;
+  }
+}
+
+/*
+ * Reads until the given text has been seen, shell echo and prompt are skipped
+ */
+static void waitFor(const char *text) {
+  size_t len = strlen(text), got = 0;
+  char c;
+
+  while (got < len) {
+    readAll(con, &c, 1);
+    if (c == text[got])
+      got++;
+    else
+      got = (c == text[0]);
+  }
+}
+
+static int openRaw(const char *dev, int timeout) {
+  struct termios tio;
+  int f;
+
+  f = open(dev, O_RDWR | O_NOCTTY);
+  if (f < 0)
+    die(dev);
+  if (tcgetattr(f, &tio) < 0)
+    die("tcgetattr");
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = timeout;            /* in 0.1 s */
+  if (tcsetattr(f, TCSANOW, &tio) < 0)
+    die("tcsetattr");
+  tcflush(f, TCIOFLUSH);
+  return f;
+}
+
+static void shell(const char *cmd) {
+
+  writeAll(con, cmd, strlen(cmd));
+  writeAll(con, "\r", 1);
+  waitFor("ch> ");
+}
+
+static void onSignal(int sig) {
+
+  (void)sig;
+  stop = 1;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+  static const uint8_t layout[RAW_CHANNELS] = RAW_CHANNEL_LAYOUT;
+  static uint8_t buf[2 * (RAW_HEADER_SIZE + 2 * RAW_MAX_SAMPLES)];
+  size_t len = 0, size;
+  double seconds, start;
+  unsigned long chunks = 0, gaps = 0, lost = 0, skipped = 0;
+  uint32_t nextSeq = 0, dropped = 0, frequency = 0;
+  uint64_t firstTime = 0, lastTime = 0;
+  struct sigaction sa;
+  CapWriter w;
+  RawHeader h;
+  int data;
+
+  if (argc < 4 || argc > 5) {
+    fprintf(stderr, "Usage: capd console data out.cap [seconds]\n");
+    return 1;
+  }
+  seconds = argc > 4 ? atof(argv[4]) : 0;
+
+  con = openRaw(argv[1], 50);
+  data = openRaw(argv[2], 5);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  writeAll(con, "\r", 1);
+  waitFor("ch> ");
+  shell("raw on");
+  shell("mc");
+  fprintf(stderr, "capturing to %s, ^C ends\n", argv[3]);
+
+  start = now();
+  while (!stop && (seconds <= 0 || now() - start < seconds)) {
+    ssize_t r = read(data, buf + len, sizeof(buf) - len);
+
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      die("read");
+    }
+    len += r;
+
+    /* whole packets, resynchronizing on the magic after garbage */
+    while (len >= RAW_HEADER_SIZE) {
+      rawGetHeader(&h, buf);
+      if (h.magic != RAW_MAGIC || h.channels != RAW_CHANNELS ||
+          (size_t)h.channels * h.sequences > RAW_MAX_SAMPLES) {
+        memmove(buf, buf + 1, --len);
+        skipped++;
+        continue;
+      }
+      size = RAW_HEADER_SIZE + 2 * (size_t)h.channels * h.sequences;
+      if (len < size)
+        break;
+      /* the header takes the frequency the first packet tells */
+      if (chunks == 0) {
+        frequency = h.frequency;
+        firstTime = h.time;
+        if (capCreate(&w, argv[3], frequency, RAW_CHANNELS, layout) < 0)
+          die(argv[3]);
+      }
+      else if (h.seq != nextSeq) {
+        gaps++;
+        lost += h.seq - nextSeq;
+      }
+      if (capAppend(&w, buf, size) < 0)
+        die("capture");
+      nextSeq = h.seq + 1;
+      dropped = h.dropped;
+      lastTime = h.time;
+      chunks++;
+      memmove(buf, buf + size, len - size);
+      len -= size;
+    }
+  }
+
+  shell("raw off");
+  shell("sc");
+  if (chunks == 0) {
+    fprintf(stderr, "no packets received\n");
+    return 1;
+  }
+  if (capClose(&w) < 0)
+    die("capture");
+
+  fprintf(stderr, "%lu chunks", chunks);
+  if (frequency)
+    fprintf(stderr, " over %.3f s", (double)(lastTime - firstTime) / frequency);
+  fprintf(stderr, ", %lu gaps with %lu half buffers lost, %u dropped by the device, "
+          "%lu bytes skipped\n", gaps, lost, dropped, skipped);
+  return 0;
+}
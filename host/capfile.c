@@ -0,0 +1,304 @@
+/*
+ * Capture files of the raw sample stream, see capfile.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/capfile.h"
+
+static void put64(uint8_t *p, uint64_t v) {
+
+  rawPut32(p, (uint32_t)v);
+  rawPut32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t get64(const uint8_t *p) {
+
+  return rawGet32(p) | (uint64_t)rawGet32(p + 4) << 32;
+}
+
+static size_t chunkSize(const RawHeader *h) {
+
+  return RAW_HEADER_SIZE + 2 * (size_t)h->channels * h->sequences;
+}
+
+/*
+ * A chunk header that can be trusted, used before a chunk is taken in
+ */
+static int chunkValid(const RawHeader *h) {
+
+  return h->magic == RAW_MAGIC && h->channels > 0 &&
+         h->channels <= CAP_MAX_CHANNELS &&
+         (size_t)h->channels * h->sequences <= RAW_MAX_SAMPLES;
+}
+
+static void putEntry(uint8_t *p, const CapEntry *e) {
+
+  put64(p, e->time);
+  put64(p + 8, e->offset);
+  rawPut32(p + 16, e->seq);
+  rawPut32(p + 20, e->sequences);
+}
+
+int capCreate(CapWriter *w, const char *path, uint32_t frequency,
+              uint16_t channels, const uint8_t *layout) {
+  uint8_t header[CAP_HEADER_SIZE];
+
+  if (channels > CAP_MAX_CHANNELS) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(w, 0, sizeof(*w));
+  w->f = fopen(path, "wb");
+  if (!w->f)
+    return -1;
+  /* chunks come every few ms, let stdio collect them */
+  setvbuf(w->f, NULL, _IOFBF, 1 << 20);
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, CAP_MAGIC, 8);
+  rawPut32(header + 8, CAP_VERSION);
+  rawPut32(header + 12, CAP_HEADER_SIZE);
+  rawPut32(header + 16, frequency);
+  rawPut16(header + 20, channels);
+  memcpy(header + 24, layout, channels);
+  put64(header + 40, (uint64_t)time(NULL));
+  if (fwrite(header, sizeof(header), 1, w->f) != 1) {
+    fclose(w->f);
+    return -1;
+  }
+  w->offset = CAP_HEADER_SIZE;
+  return 0;
+}
+
+/*
+ * Stores one packet as it came from the device and notes it in the index
+ */
+int capAppend(CapWriter *w, const uint8_t *packet, size_t n) {
+  RawHeader h;
+  CapEntry e;
+
+  rawGetHeader(&h, packet);
+  if (n < RAW_HEADER_SIZE || !chunkValid(&h) || n != chunkSize(&h)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (w->entries == w->capacity) {
+    size_t capacity = w->capacity ? 2 * w->capacity : 4096;
+    uint8_t *index = realloc(w->index, capacity * CAP_ENTRY_SIZE);
+
+    if (!index)
+      return -1;
+    w->index = index;
+    w->capacity = capacity;
+  }
+  if (fwrite(packet, n, 1, w->f) != 1)
+    return -1;
+  e.time = h.time;
+  e.offset = w->offset;
+  e.seq = h.seq;
+  e.sequences = h.sequences;
+  putEntry(w->index + w->entries * CAP_ENTRY_SIZE, &e);
+  w->entries++;
+  w->offset += n;
+  return 0;
+}
+
+/*
+ * Writes the index and the footer, then closes the file
+ */
+int capClose(CapWriter *w) {
+  uint8_t footer[CAP_FOOTER_SIZE];
+  int ret = 0;
+
+  memset(footer, 0, sizeof(footer));
+  memcpy(footer, CAP_INDEX_MAGIC, 8);
+  put64(footer + 8, w->offset);
+  put64(footer + 16, w->entries);
+  if ((w->entries > 0 &&
+       fwrite(w->index, CAP_ENTRY_SIZE, w->entries, w->f) != w->entries) ||
+      fwrite(footer, sizeof(footer), 1, w->f) != 1 || fflush(w->f) != 0 ||
+      fsync(fileno(w->f)) != 0)
+    ret = -1;
+  if (fclose(w->f) != 0)
+    ret = -1;
+  free(w->index);
+  w->index = NULL;
+  return ret;
+}
+
+/*
+ * Walks the chunks of a file without a valid footer, a torn last chunk
+ * ends the walk
+ */
+static int capRebuild(CapFile *cf) {
+  size_t pos = CAP_HEADER_SIZE, capacity = 0;
+  RawHeader h;
+  CapEntry e;
+
+  while (pos + RAW_HEADER_SIZE <= cf->size) {
+    rawGetHeader(&h, cf->map + pos);
+    if (!chunkValid(&h) || pos + chunkSize(&h) > cf->size)
+      break;
+    if (cf->entries == capacity) {
+      uint8_t *index;
+
+      capacity = capacity ? 2 * capacity : 4096;
+      index = realloc(cf->rebuilt, capacity * CAP_ENTRY_SIZE);
+      if (!index)
+        return -1;
+      cf->rebuilt = index;
+    }
+    e.time = h.time;
+    e.offset = pos;
+    e.seq = h.seq;
+    e.sequences = h.sequences;
+    putEntry(cf->rebuilt + cf->entries * CAP_ENTRY_SIZE, &e);
+    cf->entries++;
+    pos += chunkSize(&h);
+  }
+  cf->index = cf->rebuilt;
+  return 0;
+}
+
+/*
+ * Checks every entry of a stored index before it is used: each points at
+ * a valid chunk between the header and the index, and the times do not
+ * go back (capFind searches them)
+ */
+static int indexValid(const CapFile *cf, const uint8_t *index, size_t entries,
+                      uint64_t indexOffset) {
+  uint64_t prevTime = 0;
+  RawHeader h;
+  CapEntry e;
+  size_t i;
+
+  for (i = 0; i < entries; i++) {
+    e.time = get64(index + i * CAP_ENTRY_SIZE);
+    e.offset = get64(index + i * CAP_ENTRY_SIZE + 8);
+    if (e.offset < CAP_HEADER_SIZE || e.offset > indexOffset ||
+        indexOffset - e.offset < RAW_HEADER_SIZE)
+      return 0;
+    rawGetHeader(&h, cf->map + e.offset);
+    if (!chunkValid(&h) || indexOffset - e.offset < chunkSize(&h))
+      return 0;
+    if (i > 0 && e.time < prevTime)
+      return 0;
+    prevTime = e.time;
+  }
+  return 1;
+}
+
+int capOpen(CapFile *cf, const char *path) {
+  const uint8_t *footer;
+  struct stat st;
+  uint64_t indexOffset, entries;
+  void *map;
+
+  memset(cf, 0, sizeof(*cf));
+  cf->fd = open(path, O_RDONLY);
+  if (cf->fd < 0)
+    return -1;
+  if (fstat(cf->fd, &st) < 0)
+    goto fail;
+  if (st.st_size < CAP_HEADER_SIZE) {
+    errno = EINVAL;
+    goto fail;
+  }
+  cf->size = st.st_size;
+  map = mmap(NULL, cf->size, PROT_READ, MAP_SHARED, cf->fd, 0);
+  if (map == MAP_FAILED)
+    goto fail;
+  cf->map = map;
+  if (memcmp(cf->map, CAP_MAGIC, 8) != 0 ||
+      rawGet32(cf->map + 8) != CAP_VERSION ||
+      rawGet16(cf->map + 20) > CAP_MAX_CHANNELS) {
+    errno = EINVAL;
+    goto fail;
+  }
+  cf->frequency = rawGet32(cf->map + 16);
+  cf->channels = rawGet16(cf->map + 20);
+  memcpy(cf->layout, cf->map + 24, CAP_MAX_CHANNELS);
+  cf->created = get64(cf->map + 40);
+
+  if (cf->size >= CAP_HEADER_SIZE + CAP_FOOTER_SIZE) {
+    footer = cf->map + cf->size - CAP_FOOTER_SIZE;
+    indexOffset = get64(footer + 8);
+    entries = get64(footer + 16);
+    /* no sums of the footer's values, they could wrap around */
+    if (memcmp(footer, CAP_INDEX_MAGIC, 8) == 0 &&
+        indexOffset >= CAP_HEADER_SIZE &&
+        indexOffset <= cf->size - CAP_FOOTER_SIZE &&
+        (cf->size - CAP_FOOTER_SIZE - indexOffset) % CAP_ENTRY_SIZE == 0 &&
+        entries == (cf->size - CAP_FOOTER_SIZE - indexOffset) / CAP_ENTRY_SIZE &&
+        indexValid(cf, cf->map + indexOffset, entries, indexOffset)) {
+      cf->index = cf->map + indexOffset;
+      cf->entries = entries;
+      cf->hadIndex = 1;
+      return 0;
+    }
+  }
+  if (capRebuild(cf) == 0)
+    return 0;
+
+fail:
+  capFileClose(cf);
+  return -1;
+}
+
+void capFileClose(CapFile *cf) {
+
+  if (cf->map)
+    munmap((void *)cf->map, cf->size);
+  if (cf->fd >= 0)
+    close(cf->fd);
+  free(cf->rebuilt);
+  memset(cf, 0, sizeof(*cf));
+  cf->fd = -1;
+}
+
+void capEntry(const CapFile *cf, size_t i, CapEntry *e) {
+  const uint8_t *p = cf->index + i * CAP_ENTRY_SIZE;
+
+  e->time = get64(p);
+  e->offset = get64(p + 8);
+  e->seq = rawGet32(p + 16);
+  e->sequences = rawGet32(p + 20);
+}
+
+/*
+ * First chunk that ends at or after time (chunk times are taken when a
+ * half buffer is complete), entries if there is none. Binary search over
+ * the index, only the touched entries are paged in.
+ */
+size_t capFind(const CapFile *cf, uint64_t time) {
+  size_t lo = 0, hi = cf->entries;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (get64(cf->index + mid * CAP_ENTRY_SIZE) < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*
+ * Header and samples of chunk i, straight from the mapping
+ */
+const uint8_t *capChunk(const CapFile *cf, size_t i, RawHeader *h) {
+  CapEntry e;
+
+  capEntry(cf, i, &e);
+  rawGetHeader(h, cf->map + e.offset);
+  return cf->map + e.offset + RAW_HEADER_SIZE;
+}
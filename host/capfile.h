@@ -0,0 +1,98 @@
+/*
+ * Capture files of the raw sample stream, written by capd and read with
+ * mmap by the analysis tools.
+ *
+ * Build it together with a tool:
+ *   gcc -O2 -Wall -I. -c host/capfile.c
+ *
+ * Layout, all little endian:
+ *   file header, CAP_HEADER_SIZE bytes:
+ *     magic "ADCCAP01", version u32, header size u32, frequency u32,
+ *     channels u16, reserved u16, channel layout u8[16], created u64
+ *     (unix time), reserved to the end
+ *   chunks: the RAW packets of the device unchanged, header included
+ *     (sequence, cycle timestamp, channel count, dropped so far), see
+ *     myRawProto.h
+ *   index, one CAP_ENTRY_SIZE entry per chunk, sorted by time:
+ *     time u64, file offset u64, seq u32, sequences u32
+ *   footer, CAP_FOOTER_SIZE bytes:
+ *     magic "CAPIDX01", index offset u64, entries u64, reserved u64
+ *
+ * The index and the footer are written when the capture ends. A file
+ * without them (capd killed, disk full) is still readable, capOpen then
+ * rebuilds the index by walking the chunks and ignores a torn last one.
+ * It does the same if any entry of a stored index points outside the
+ * chunks, at a broken chunk header or back in time.
+ */
+#ifndef CAPFILE_H_INCLUDED
+#define CAPFILE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "myRawProto.h"
+
+#define CAP_MAGIC               "ADCCAP01"
+#define CAP_INDEX_MAGIC         "CAPIDX01"
+#define CAP_VERSION             2
+#define CAP_HEADER_SIZE         64
+#define CAP_ENTRY_SIZE          24
+#define CAP_FOOTER_SIZE         32
+#define CAP_MAX_CHANNELS        16
+
+typedef struct {
+  uint64_t time;
+  uint64_t offset;
+  uint32_t seq;
+  uint32_t sequences;
+} CapEntry;
+
+typedef struct {
+  FILE *f;
+  uint64_t offset;                      /* where the next chunk goes        */
+  uint8_t *index;                       /* entries in file format           */
+  size_t entries, capacity;
+} CapWriter;
+
+typedef struct {
+  int fd;
+  const uint8_t *map;
+  size_t size;
+  uint32_t frequency;
+  uint16_t channels;
+  uint8_t layout[CAP_MAX_CHANNELS];
+  uint64_t created;
+  const uint8_t *index;                 /* mapped, or rebuilt into heap     */
+  uint8_t *rebuilt;
+  size_t entries;
+  int hadIndex;
+} CapFile;
+
+/*
+ * Writer, all return 0 or -1 with errno set
+ */
+int capCreate(CapWriter *w, const char *path, uint32_t frequency,
+              uint16_t channels, const uint8_t *layout);
+int capAppend(CapWriter *w, const uint8_t *packet, size_t n);
+int capClose(CapWriter *w);
+
+/*
+ * Reader, capOpen returns 0 or -1 with errno set (EINVAL for a file that
+ * is not a capture)
+ */
+int capOpen(CapFile *cf, const char *path);
+void capFileClose(CapFile *cf);
+void capEntry(const CapFile *cf, size_t i, CapEntry *e);
+size_t capFind(const CapFile *cf, uint64_t time);
+const uint8_t *capChunk(const CapFile *cf, size_t i, RawHeader *h);
+
+/*
+ * Sample of one channel in one sequence of a chunk's samples
+ */
+static inline uint16_t capSample(const uint8_t *samples, const RawHeader *h,
+                                 unsigned sequence, unsigned channel) {
+
+  return rawGet16(samples + 2 * ((size_t)sequence * h->channels + channel));
+}
+
+#endif // CAPFILE_H_INCLUDED
@@ -0,0 +1,115 @@
+/*
+ * Summary of a capture file written by capd.
+ *
+ *   gcc -O2 -Wall -I. -o capinfo host/capinfo.c host/capfile.c
+ *   ./capinfo out.cap [from_s to_s]
+ *
+ * Prints the header, the number of chunks, the duration and the gaps in
+ * seq. With a time range (seconds from the first chunk) it seeks to it
+ * through the index and prints min/mean/max of every channel over the
+ * sequences in the range, the rest of the file is never touched.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/capfile.h"
+
+int main(int argc, char *argv[]) {
+  CapFile cf;
+  CapEntry first, last, e;
+  RawHeader h;
+  unsigned long gaps = 0, lost = 0, sequences = 0;
+  uint64_t from, to, t, step;
+  uint32_t min[CAP_MAX_CHANNELS], max[CAP_MAX_CHANNELS];
+  double sum[CAP_MAX_CHANNELS];
+  const uint8_t *samples;
+  size_t i;
+  unsigned s, c;
+
+  if (argc != 2 && argc != 4) {
+    fprintf(stderr, "Usage: capinfo file.cap [from_s to_s]\n");
+    return 1;
+  }
+  if (capOpen(&cf, argv[1]) < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  printf("frequency  : %u Hz\n", cf.frequency);
+  printf("channels   :");
+  for (c = 0; c < cf.channels; c++)
+    printf(" %u", cf.layout[c]);
+  printf("\nindex      : %s\n", cf.hadIndex ? "stored" : "rebuilt, the capture was not closed");
+  printf("chunks     : %zu\n", cf.entries);
+  if (cf.entries == 0 || cf.frequency == 0) {
+    capFileClose(&cf);
+    return 0;
+  }
+  capEntry(&cf, 0, &first);
+  capEntry(&cf, cf.entries - 1, &last);
+  for (i = 1; i < cf.entries; i++) {
+    CapEntry prev;
+
+    capEntry(&cf, i - 1, &prev);
+    capEntry(&cf, i, &e);
+    if (e.seq != prev.seq + 1) {
+      gaps++;
+      lost += e.seq - prev.seq - 1;
+    }
+  }
+  printf("duration   : %.3f s\n", (double)(last.time - first.time) / cf.frequency);
+  printf("gaps       : %lu, %lu half buffers lost\n", gaps, lost);
+  if (argc == 2) {
+    capFileClose(&cf);
+    return 0;
+  }
+
+  from = first.time + (uint64_t)(atof(argv[2]) * cf.frequency);
+  to = first.time + (uint64_t)(atof(argv[3]) * cf.frequency);
+  for (c = 0; c < cf.channels; c++) {
+    min[c] = UINT32_MAX;
+    max[c] = 0;
+    sum[c] = 0;
+  }
+  /* sequences are spread evenly between the end of the previous chunk
+     and the end of this one */
+  for (i = capFind(&cf, from); i < cf.entries; i++) {
+    uint64_t end;
+
+    samples = capChunk(&cf, i, &h);
+    end = h.time;
+    if (i > 0) {
+      capEntry(&cf, i - 1, &e);
+      step = (end - e.time) / (h.sequences ? h.sequences : 1);
+    }
+    else
+      step = 0;
+    if (end - (uint64_t)step * h.sequences > to)
+      break;
+    for (s = 0; s < h.sequences; s++) {
+      t = end - step * (h.sequences - 1 - s);
+      if (t < from || t > to)
+        continue;
+      for (c = 0; c < h.channels && c < CAP_MAX_CHANNELS; c++) {
+        uint16_t v = capSample(samples, &h, s, c);
+
+        if (v < min[c])
+          min[c] = v;
+        if (v > max[c])
+          max[c] = v;
+        sum[c] += v;
+      }
+      sequences++;
+    }
+  }
+  printf("range      : %s s to %s s, %lu sequences\n", argv[2], argv[3], sequences);
+  if (sequences > 0) {
+    printf("channel  adc      min      mean      max\n");
+    for (c = 0; c < cf.channels; c++)
+      printf("%7u %4u %8u %9.2f %8u\n", c, cf.layout[c], min[c],
+             sum[c] / sequences, max[c]);
+  }
+  capFileClose(&cf);
+  return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Test of the number formatter (myFormatCore.c) against snprintf.
+ *
+ *   gcc -O2 -Wall -I. -o fmttest host/fmttest.c myFormatCore.c
+ *   ./fmttest
+ *
+ * Or run all host tests with make -C host test. Exits with 1 on failure.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "myFormatCore.h"
+
+static int failures;
+
+static void check(const char *what, const char *got, size_t n, const char *want) {
+
+  if (n != strlen(want) || memcmp(got, want, n) != 0) {
+    printf("%s: got \"%.*s\", want \"%s\"\n", what, (int)n, got, want);
+    failures++;
+  }
+}
+
+static void checkU32(uint32_t v) {
+  char got[FMT_U32_MAXLEN], want[32];
+
+  snprintf(want, sizeof(want), "%" PRIu32, v);
+  check("fmtU32", got, fmtU32(got, v), want);
+  snprintf(want, sizeof(want), "%" PRIX32, v);
+  check("fmtHex32", got, fmtHex32(got, v), want);
+}
+
+static void checkU64(uint64_t v) {
+  char got[FMT_U64_MAXLEN], want[32];
+
+  snprintf(want, sizeof(want), "%" PRIu64, v);
+  check("fmtU64", got, fmtU64(got, v), want);
+}
+
+/*
+ * Everything written to the chunk writer, and the size of each write
+ */
+static char written[4096];
+static size_t writtenLen;
+static int writes, badWrites;
+
+static void chunkWrite(void *ctx, const char *p, size_t n) {
+
+  (void)ctx;
+  if (n == 0 || n > FMT_CHUNK_SIZE)
+    badWrites++;
+  memcpy(written + writtenLen, p, n);
+  writtenLen += n;
+  writes++;
+}
+
+static void checkChunks(int hex, const char *sep) {
+  char want[sizeof(written)];
+  size_t wantLen = 0;
+  FmtChunk c;
+  uint32_t v;
+  int i;
+
+  writtenLen = 0;
+  writes = 0;
+  badWrites = 0;
+  fmtChunkInit(&c, chunkWrite, NULL, sep, hex);
+  for (i = 0; i < 200; i++) {
+    v = (uint32_t)i * 2654435761u >> (i % 32);
+    fmtChunkPut(&c, v);
+    wantLen += snprintf(want + wantLen, sizeof(want) - wantLen,
+                        hex ? "%" PRIX32 "%s" : "%" PRIu32 "%s", v, sep);
+  }
+  fmtChunkFlush(&c);
+  check(hex ? "chunks hex" : "chunks dec", written, writtenLen, want);
+  /* a value only goes to the next chunk if it did not fit anymore */
+  if (badWrites || writes > (int)(wantLen / (FMT_CHUNK_SIZE - FMT_U32_MAXLEN - strlen(sep))) + 1) {
+    printf("chunks: %d writes, %d of a bad size\n", writes, badWrites);
+    failures++;
+  }
+}
+
+int main(void) {
+  static const uint32_t u32[] = {
+    0, 1, 9, 10, 11, 99, 100, 101, 999, 1000, 4095, 65535, 99999999,
+    100000000, 999999999, 1000000000, 4294967294u, UINT32_MAX
+  };
+  static const uint64_t u64[] = {
+    0, 9, 10, 99, 100, UINT32_MAX, (uint64_t)UINT32_MAX + 1,
+    999999999, 1000000000, 1000000001, 999999999999999999ull,
+    1000000000000000000ull, 10000000000000000000ull, UINT64_MAX
+  };
+  char hex[FMT_U32_MAXLEN];
+  unsigned i, bits;
+
+  for (i = 0; i < sizeof(u32) / sizeof(u32[0]); i++)
+    checkU32(u32[i]);
+  /* every hex width and the values around it */
+  for (bits = 1; bits <= 32; bits++) {
+    checkU32((uint32_t)(((uint64_t)1 << bits) - 1));
+    checkU32((uint32_t)1 << (bits - 1));
+  }
+  for (i = 0; i < sizeof(u64) / sizeof(u64[0]); i++)
+    checkU64(u64[i]);
+  for (bits = 1; bits <= 64; bits++) {
+    checkU64(bits == 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1);
+    checkU64((uint64_t)1 << (bits - 1));
+  }
+  /* the shell's chprintf %x prints uppercase, the fast path has to match */
+  check("fmtHex32 digits", hex, fmtHex32(hex, 0xABCDEF09u), "ABCDEF09");
+  checkChunks(0, "  ");
+  checkChunks(1, "  ");
+  checkChunks(0, "\r\n");
+  printf("fmttest: %s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Host side of the rec console command.
+ *
+ *   gcc -O2 -Wall -I. -o recdump host/recdump.c
+ *   ./recdump [/dev/ttyACM0 | dump.bin] [last]
+ *
+ * Fetches the flight recorder (with "last" the one of the boot before the
+ * last fault) or reads a dump saved earlier, everything after the
+ * "REC <bytes>" line, and prints one decoded line per event, oldest first,
+ * with its time since boot in us.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "myRecEvents.h"
+
+static const char *names[] = {REC_EV_NAMES};
+
+/* ChibiOS 2.5 usbevent_t and adcerror_t */
+static const char *usbEvents[] = {
+  "reset", "address", "configured", "suspend", "wakeup", "stalled"
+};
+static const char *adcErrors[] = {"dma failure", "overflow"};
+
+static int fd;
+
+static void die(const char *what) {
+
+  perror(what);
+  exit(1);
+}
+
+static void writeAll(int f, const void *buf, size_t n) {
+  const uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t w = write(f, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      die("write");
+    }
+    p += w;
+    n -= w;
+  }
+}
+
+static void readAll(int f, void *buf, size_t n) {
+  uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t r = read(f, p, n);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      die("read");
+    }
+    if (r == 0) {
+      fprintf(stderr, "timeout or short dump\n");
+      exit(1);
+    }
+    p += r;
+    n -= r;
+  }
+}
+
+/*
+ * Reads until the given text has been seen, shell echo and prompt are skipped
+ */
+static void waitFor(const char *text) {
+  size_t len = strlen(text), got = 0;
+  char c;
+
+  while (got < len) {
+    readAll(fd, &c, 1);
+    if (c == text[got])
+      got++;
+    else
+      got = (c == text[0]);
+  }
+}
+
+static int openRaw(const char *dev) {
+  struct termios tio;
+  int f;
+
+  f = open(dev, O_RDWR | O_NOCTTY);
+  if (f < 0)
+    die(dev);
+  if (tcgetattr(f, &tio) < 0)
+    die("tcgetattr");
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 50;                 /* 5 s read timeout */
+  if (tcsetattr(f, TCSANOW, &tio) < 0)
+    die("tcsetattr");
+  tcflush(f, TCIOFLUSH);
+  return f;
+}
+
+static uint32_t get32(const uint8_t *p) {
+
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t get16(const uint8_t *p) {
+
+  return p[0] | p[1] << 8;
+}
+
+static void printArgs(uint16_t id, uint32_t a, uint32_t b) {
+
+  switch (id) {
+  case REC_EV_BOOT:
+    printf("csr 0x%08x%s%s%s", a, a & (1u << 26) ? " pin" : "",
+           a & (1u << 27) ? " por" : "", a & (1u << 28) ? " software" : "");
+    break;
+  case REC_EV_FAULT:
+    printf("pc 0x%08x cfsr 0x%08x", a, b);
+    break;
+  case REC_EV_PANIC:
+    printf("message at 0x%08x", a);
+    break;
+  case REC_EV_TIME:
+    printf("%llu cycles", (unsigned long long)a << 32 | b);
+    break;
+  case REC_EV_ADC_HALF:
+    printf("%u samples p1 %u", a, b);
+    break;
+  case REC_EV_ADC_OVERFLOW:
+    printf("overflow %u p1 %u", a, b);
+    break;
+  case REC_EV_ADC_ERROR:
+    printf("%s, overflow %u", a < 2 ? adcErrors[a] : "?", b);
+    break;
+  case REC_EV_ADC_READ_ERROR:
+    printf("p2 %u value %u", a, b);
+    break;
+  case REC_EV_ADC_START:
+  case REC_EV_ADC_STOP:
+    printf("%s", a ? "one-shot" : "");
+    break;
+  case REC_EV_PWM_WIDTH:
+    printf("channel %u width %u", a, b);
+    break;
+  case REC_EV_PWM_PERIOD:
+    printf("period %u", a);
+    break;
+  case REC_EV_USB:
+    printf("%s", a < 6 ? usbEvents[a] : "?");
+    break;
+  case REC_EV_ADC_LIMIT:
+    printf("channel %u %s %u", a >> 16, b ? "above" : "below", a & 0xffff);
+    break;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *src = argc > 1 ? argv[1] : "/dev/ttyACM0";
+  int last = argc > 2 && strcmp(argv[2], "last") == 0;
+  uint8_t *dump, *p;
+  uint32_t freq, head, fault, count, i, torn = 0, prev = 0;
+  char line[64];
+  unsigned long size;
+  struct stat st;
+  uint64_t *rel, acc = 0;
+  int64_t offset = 0;
+  int anchored = 0, first = 1;
+
+  if (stat(src, &st) == 0 && S_ISREG(st.st_mode)) {
+    fd = open(src, O_RDONLY);
+    if (fd < 0)
+      die(src);
+    size = st.st_size;
+  }
+  else {
+    size_t n = 0;
+
+    fd = openRaw(src);
+    writeAll(fd, "\r", 1);
+    waitFor("ch> ");
+    if (last)
+      writeAll(fd, "rec last\r", 9);
+    else
+      writeAll(fd, "rec\r", 4);
+    waitFor("REC ");
+    do {
+      readAll(fd, &line[n], 1);
+    } while (line[n] != '\n' && ++n < sizeof(line) - 1);
+    line[n] = 0;
+    size = strtoul(line, NULL, 10);
+  }
+  if (size < REC_HEADER_SIZE) {
+    fprintf(stderr, "no recording\n");
+    return 1;
+  }
+  dump = malloc(size);
+  if (!dump)
+    die("malloc");
+  readAll(fd, dump, size);
+  close(fd);
+
+  if (get32(dump) != REC_MAGIC) {
+    fprintf(stderr, "not a recorder dump\n");
+    return 1;
+  }
+  freq = get32(dump + 4);
+  head = get32(dump + 8);
+  fault = get32(dump + 12);
+  count = get32(dump + 16);
+  if (size != REC_HEADER_SIZE + count * (unsigned long)REC_EVENT_SIZE) {
+    fprintf(stderr, "dump size does not match its header\n");
+    return 1;
+  }
+
+  /* 32 bit cycle times to one 64 bit time line, the TIME events (at least
+     one every 10 s) keep the gaps below the counter's 25 s wrap */
+  rel = calloc(count + 1, sizeof(uint64_t));
+  if (!rel)
+    die("calloc");
+  p = dump + REC_HEADER_SIZE;
+  for (i = 0; i < count; i++, p += REC_EVENT_SIZE) {
+    uint32_t t = get32(p);
+
+    if (get16(p + 6) != (uint16_t)(head - count + i))
+      continue;
+    if (!first)
+      acc += (uint32_t)(t - prev);
+    rel[i] = acc;
+    first = 0;
+    prev = t;
+    if (!anchored && get16(p + 4) == REC_EV_TIME) {
+      offset = (int64_t)((uint64_t)get32(p + 8) << 32 | get32(p + 12)) - (int64_t)rel[i];
+      anchored = 1;
+    }
+  }
+
+  printf("%u events logged, %u in the dump%s, times %s\n", head, count,
+         fault ? ", ended by a fault" : "",
+         anchored ? "since boot" : "since the first event");
+  p = dump + REC_HEADER_SIZE;
+  for (i = 0; i < count; i++, p += REC_EVENT_SIZE) {
+    uint16_t id = get16(p + 4);
+
+    if (get16(p + 6) != (uint16_t)(head - count + i)) {
+      torn++;
+      continue;
+    }
+    printf("%14.2f us  %-15s ", (double)(rel[i] + offset) * 1e6 / freq,
+           id < REC_EV_COUNT ? names[id] : "?");
+    printArgs(id, get32(p + 8), get32(p + 12));
+    printf("\n");
+  }
+  if (torn)
+    printf("%u events were overwritten during the dump\n", torn);
+  free(rel);
+  free(dump);
+  return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Replays a capture file through the half buffer processing of the
+ * continuous conversion.
+ *
+ *   gcc -O2 -Wall -I. -o replay host/replay.c host/capfile.c
+ *   ./replay out.cap [-q] [-r] [from_s to_s]
+ *
+ * Every chunk goes through adcPipeHalf of myADCPipe.h, the code the
+ * device runs in adccallback, starting from the same VREFMeasured. Prints
+ * one line per half buffer (seq, time in us since the first chunk, data,
+ * vref, temp, VREFMeasured after it), with -q only the summary. The
+ * summary has a digest of all results, equal digests mean bit exact
+ * equal output, and the time spent in adcPipeHalf per half buffer.
+ * Full speed by default, -r paces the chunks by their timestamps.
+ *
+ * Half buffers the device dropped from the stream still went through
+ * its pipeline, so VREFMeasured after a gap in seq may differ from the
+ * device, the gaps are counted.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host/capfile.h"
+#include "myADCPipe.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the samples are used in place, which needs a little endian host"
+#endif
+
+static uint64_t digest = 14695981039346656037ULL;
+
+/*
+ * FNV-1a over the little endian bytes of v
+ */
+static void digest32(uint32_t v) {
+  unsigned i;
+
+  for (i = 0; i < 4; i++) {
+    digest ^= (v >> (8 * i)) & 0xff;
+    digest *= 1099511628211ULL;
+  }
+}
+
+static uint64_t nsNow(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = NULL, *range[2];
+  int quiet = 0, realtime = 0, usage = 0;
+  unsigned nrange = 0;
+  uint32_t vrefMeasured = ADC_PIPE_VREF_INIT;
+  unsigned long halves = 0, gaps = 0, skipped = 0;
+  uint64_t from = 0, to = UINT64_MAX, t0, tStart = 0, wall0, busy = 0, start;
+  uint64_t samplesDone = 0;
+  CapFile cf;
+  CapEntry first;
+  RawHeader h;
+  AdcHousekeeping hk;
+  AdcHalf out;
+  size_t i;
+  uint32_t nextSeq = 0;
+  int k;
+
+  for (k = 1; k < argc; k++) {
+    if (strcmp(argv[k], "-q") == 0)
+      quiet = 1;
+    else if (strcmp(argv[k], "-r") == 0)
+      realtime = 1;
+    else if (!path)
+      path = argv[k];
+    else if (nrange < 2)
+      range[nrange++] = argv[k];
+    else
+      usage = 1;
+  }
+  if (usage || !path || nrange == 1) {
+    fprintf(stderr, "Usage: replay file.cap [-q] [-r] [from_s to_s]\n");
+    return 1;
+  }
+  if (capOpen(&cf, path) < 0) {
+    perror(path);
+    return 1;
+  }
+  if (cf.entries == 0 || cf.frequency == 0) {
+    fprintf(stderr, "empty capture\n");
+    return 1;
+  }
+  if (cf.channels != ADC_CONT_NUM_CHANNELS) {
+    fprintf(stderr, "capture has %u channels, the pipeline takes %u\n",
+            cf.channels, ADC_CONT_NUM_CHANNELS);
+    return 1;
+  }
+  capEntry(&cf, 0, &first);
+  t0 = first.time;
+  if (nrange == 2) {
+    from = t0 + (uint64_t)(atof(range[0]) * cf.frequency);
+    to = t0 + (uint64_t)(atof(range[1]) * cf.frequency);
+  }
+
+  wall0 = nsNow();
+  for (i = capFind(&cf, from); i < cf.entries; i++) {
+    const uint16_t *samples = (const uint16_t *)capChunk(&cf, i, &h);
+
+    if (h.time > to)
+      break;
+    if (h.channels != ADC_CONT_NUM_CHANNELS || h.sequences < 2 ||
+        h.sequences % 2 != 0) {
+      skipped++;
+      continue;
+    }
+    if (halves > 0 && h.seq != nextSeq)
+      gaps++;
+    nextSeq = h.seq + 1;
+    if (halves == 0)
+      tStart = h.time;
+    if (realtime) {
+      uint64_t due = wall0 + (uint64_t)((double)(h.time - tStart) * 1e9 / cf.frequency);
+      struct timespec ts = {due / 1000000000, due % 1000000000};
+
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+
+    hk.vref = h.vrefSum;
+    hk.temp = h.tempSum;
+    hk.count = h.hkCount;
+    hk.vrefLast = h.vrefLast;
+    hk.tempLast = h.tempLast;
+    start = nsNow();
+    adcPipeHalf(samples, h.sequences, &hk, &vrefMeasured, &out, NULL);
+    busy += nsNow() - start;
+
+    digest32(out.data);
+    digest32(out.vref);
+    digest32(out.temp);
+    digest32(vrefMeasured);
+    halves++;
+    samplesDone += (uint64_t)h.sequences * ADC_CONT_NUM_CHANNELS;
+    if (!quiet)
+      printf("%u %.1f %u %u %u %u\n", h.seq, (double)(h.time - t0) * 1e6 / cf.frequency,
+             out.data, out.vref, out.temp, vrefMeasured);
+  }
+
+  fprintf(stderr, "%lu half buffers, %lu gaps, %lu chunks skipped, digest %016llx\n",
+          halves, gaps, skipped, (unsigned long long)digest);
+  if (halves > 0)
+    fprintf(stderr, "adcPipeHalf %.1f ns per half buffer, %.1f Msamples/s, "
+            "%.3f s wall\n", (double)busy / halves,
+            samplesDone * 1e3 / (busy ? busy : 1),
+            (nsNow() - wall0) * 1e-9);
+  capFileClose(&cf);
+  return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Client library for the binary RPC server, see rpc.h
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "host/rpc.h"
+
+int rpcOpen(RpcClient *c, const char *dev) {
+  struct termios tio;
+  static const uint8_t delimiter = 0;
+
+  memset(c, 0, sizeof(*c));
+  c->fd = open(dev, O_RDWR | O_NOCTTY);
+  if (c->fd < 0)
+    return -1;
+  if (tcgetattr(c->fd, &tio) < 0 ||
+      (cfmakeraw(&tio), tcsetattr(c->fd, TCSANOW, &tio)) < 0) {
+    close(c->fd);
+    return -1;
+  }
+  tcflush(c->fd, TCIOFLUSH);
+  /* ends whatever a previous client left half sent */
+  if (write(c->fd, &delimiter, 1) != 1) {
+    close(c->fd);
+    return -1;
+  }
+  return 0;
+}
+
+void rpcClose(RpcClient *c) {
+
+  close(c->fd);
+}
+
+static int writeAll(int fd, const uint8_t *p, size_t n) {
+
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += w;
+    n -= w;
+  }
+  return 0;
+}
+
+/*
+ * Sends a request without waiting for the answer, returns its id
+ */
+int rpcSend(RpcClient *c, uint8_t op, const void *payload, size_t n) {
+  uint8_t msg[RPC_REQUEST_HEADER + RPC_MAX_PAYLOAD + RPC_CRC_SIZE];
+  uint8_t frame[RPC_COBS_SIZE(sizeof(msg))];
+  uint16_t id = c->nextId++;
+
+  if (n > RPC_MAX_PAYLOAD)
+    return -1;
+  rpcPut16(msg, id);
+  msg[2] = op;
+  if (n > 0)
+    memcpy(msg + RPC_REQUEST_HEADER, payload, n);
+  n = rpcFrame(frame, msg, RPC_REQUEST_HEADER + n);
+  if (writeAll(c->fd, frame, n) < 0)
+    return -1;
+  return id;
+}
+
+/*
+ * Waits for the next valid response, frames with a bad CRC are skipped
+ */
+int rpcReceive(RpcClient *c, RpcResponse *r, int timeoutMs) {
+  struct pollfd pfd = { c->fd, POLLIN, 0 };
+  uint8_t b;
+  int n;
+
+  for (;;) {
+    if (c->bufPos == c->bufLen) {
+      if (poll(&pfd, 1, timeoutMs) <= 0)
+        return -1;
+      n = read(c->fd, c->buf, sizeof(c->buf));
+      if (n <= 0)
+        return -1;
+      c->bufPos = 0;
+      c->bufLen = n;
+    }
+    b = c->buf[c->bufPos++];
+    if (b != 0) {
+      if (c->frameLen < sizeof(c->frame))
+        c->frame[c->frameLen++] = b;
+      else
+        c->overrun = 1;
+      continue;
+    }
+    n = c->overrun ? -1 : rpcUnframe(c->frame, c->frameLen);
+    c->frameLen = 0;
+    c->overrun = 0;
+    /* a valid CRC does not make the length fit into the payload */
+    if (n < RPC_RESPONSE_HEADER || n - RPC_RESPONSE_HEADER > RPC_MAX_PAYLOAD) {
+      c->badFrames++;
+      continue;
+    }
+    r->id = rpcGet16(c->frame);
+    r->op = c->frame[2] & ~RPC_RESPONSE_FLAG;
+    r->status = c->frame[3];
+    r->n = n - RPC_RESPONSE_HEADER;
+    memcpy(r->payload, c->frame + RPC_RESPONSE_HEADER, r->n);
+    return 0;
+  }
+}
+
+/*
+ * One request, one response
+ */
+int rpcCall(RpcClient *c, uint8_t op, const void *payload, size_t n,
+            RpcResponse *r) {
+  int id = rpcSend(c, op, payload, n);
+
+  if (id < 0)
+    return -1;
+  do {
+    if (rpcReceive(c, r, RPC_TIMEOUT_MS) < 0)
+      return -1;
+  } while (r->id != id);
+  return r->status;
+}
+
+int rpcPing(RpcClient *c, const void *payload, size_t n) {
+  RpcResponse r;
+  int s = rpcCall(c, RPC_OP_PING, payload, n, &r);
+
+  if (s == RPC_OK && (r.n != n || memcmp(r.payload, payload, n) != 0))
+    return -1;
+  return s;
+}
+
+int rpcPwmSet(RpcClient *c, unsigned channel, uint32_t width) {
+  RpcResponse r;
+  uint8_t p[5];
+
+  p[0] = channel;
+  rpcPut32(p + 1, width);
+  return rpcCall(c, RPC_OP_PWM_SET, p, sizeof(p), &r);
+}
+
+int rpcAdcCapture(RpcClient *c, unsigned count, uint32_t *sum,
+                  uint16_t *min, uint16_t *max) {
+  RpcResponse r;
+  uint8_t p[2];
+  int s;
+
+  rpcPut16(p, count);
+  s = rpcCall(c, RPC_OP_ADC_CAPTURE, p, sizeof(p), &r);
+  if (s != RPC_OK)
+    return s;
+  if (r.n != 10)
+    return -1;
+  if (sum)
+    *sum = rpcGet32(r.payload + 2);
+  if (min)
+    *min = rpcGet16(r.payload + 6);
+  if (max)
+    *max = rpcGet16(r.payload + 8);
+  return s;
+}
+
+/*
+ * Reads samples of the last capture, with up to RPC_READ_WINDOW chunks
+ * in flight. The device answers in order, so the chunks arrive in order.
+ */
+int rpcAdcRead(RpcClient *c, unsigned offset, unsigned count, uint16_t *samples) {
+  const unsigned chunk = RPC_MAX_PAYLOAD / 2;
+  unsigned sent = 0, received = 0, inFlight = 0, n, i;
+  int status = RPC_OK;
+  RpcResponse r;
+  uint8_t p[4];
+
+  /* after an error only the chunks still in flight are collected */
+  while (inFlight > 0 || (status == RPC_OK && sent < count)) {
+    while (status == RPC_OK && inFlight < RPC_READ_WINDOW && sent < count) {
+      n = count - sent < chunk ? count - sent : chunk;
+      rpcPut16(p, offset + sent);
+      rpcPut16(p + 2, n);
+      if (rpcSend(c, RPC_OP_ADC_READ, p, sizeof(p)) < 0)
+        return -1;
+      sent += n;
+      inFlight++;
+    }
+    if (rpcReceive(c, &r, RPC_TIMEOUT_MS) < 0)
+      return -1;
+    if (r.op != RPC_OP_ADC_READ)
+      continue;
+    inFlight--;
+    if (r.status != RPC_OK)
+      status = r.status;
+    if (status != RPC_OK)
+      continue;
+    for (i = 0; i < r.n / 2 && received < count; i++)
+      samples[received++] = rpcGet16(r.payload + 2 * i);
+  }
+  return status;
+}
+
+int rpcStats(RpcClient *c, uint32_t stats[RPC_STAT_COUNT]) {
+  RpcResponse r;
+  int s = rpcCall(c, RPC_OP_STATS, NULL, 0, &r);
+  unsigned i;
+
+  if (s != RPC_OK)
+    return s;
+  if (r.n != 4 * RPC_STAT_COUNT)
+    return -1;
+  for (i = 0; i < RPC_STAT_COUNT; i++)
+    stats[i] = rpcGet32(r.payload + 4 * i);
+  return s;
+}
+
+int rpcConfigGet(RpcClient *c, uint8_t key, uint32_t *value) {
+  RpcResponse r;
+  int s = rpcCall(c, RPC_OP_CONFIG_GET, &key, 1, &r);
+
+  if (s != RPC_OK)
+    return s;
+  if (r.n != 4)
+    return -1;
+  *value = rpcGet32(r.payload);
+  return s;
+}
+
+int rpcConfigSet(RpcClient *c, uint8_t key, uint32_t value) {
+  RpcResponse r;
+  uint8_t p[5];
+
+  p[0] = key;
+  rpcPut32(p + 1, value);
+  return rpcCall(c, RPC_OP_CONFIG_SET, p, sizeof(p), &r);
+}
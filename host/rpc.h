@@ -0,0 +1,64 @@
+/*
+ * Client library for the binary RPC server on the data channel,
+ * the protocol itself is described in myRpcProto.h.
+ *
+ * Build it together with the shared protocol code:
+ *   gcc -O2 -Wall -I. -c host/rpc.c myRpcProto.c
+ *
+ * All calls return the RPC status (RPC_OK, RPC_E_*) or -1 if the device
+ * did not answer or the link failed. rpcSend and rpcReceive can be used
+ * directly to keep several requests in flight.
+ */
+#ifndef RPC_H_INCLUDED
+#define RPC_H_INCLUDED
+
+#include "myRpcProto.h"
+
+#define RPC_TIMEOUT_MS          2000
+
+/*
+ * Requests rpcAdcRead keeps in flight
+ */
+#define RPC_READ_WINDOW         8
+
+typedef struct {
+  uint16_t id;
+  uint8_t op;
+  uint8_t status;
+  size_t n;
+  uint8_t payload[RPC_MAX_PAYLOAD];
+} RpcResponse;
+
+typedef struct {
+  int fd;
+  uint16_t nextId;
+  uint8_t frame[RPC_COBS_SIZE(RPC_MAX_FRAME)];
+  size_t frameLen;
+  int overrun;
+  uint8_t buf[4096];
+  size_t bufPos, bufLen;
+  unsigned long badFrames;
+} RpcClient;
+
+int rpcOpen(RpcClient *c, const char *dev);
+void rpcClose(RpcClient *c);
+
+int rpcSend(RpcClient *c, uint8_t op, const void *payload, size_t n);
+int rpcReceive(RpcClient *c, RpcResponse *r, int timeoutMs);
+int rpcCall(RpcClient *c, uint8_t op, const void *payload, size_t n,
+            RpcResponse *r);
+
+int rpcPing(RpcClient *c, const void *payload, size_t n);
+int rpcPwmSet(RpcClient *c, unsigned channel, uint32_t width);
+/*
+ * The device frees a capture once its last sample has been read, or
+ * after 5 s without a read
+ */
+int rpcAdcCapture(RpcClient *c, unsigned count, uint32_t *sum,
+                  uint16_t *min, uint16_t *max);
+int rpcAdcRead(RpcClient *c, unsigned offset, unsigned count, uint16_t *samples);
+int rpcStats(RpcClient *c, uint32_t stats[RPC_STAT_COUNT]);
+int rpcConfigGet(RpcClient *c, uint8_t key, uint32_t *value);
+int rpcConfigSet(RpcClient *c, uint8_t key, uint32_t value);
+
+#endif // RPC_H_INCLUDED
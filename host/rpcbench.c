@@ -0,0 +1,226 @@
+/*
+ * Compares the text shell with the binary RPC server.
+ *
+ *   gcc -O2 -Wall -I. -o rpcbench host/rpcbench.c host/rpc.c myRpcProto.c
+ *   ./rpcbench [/dev/ttyACM0] [/dev/ttyUSB0] [rounds]
+ *
+ * The first device is the console, the second the data channel (see
+ * README). Sets the PWM duty cycle through "cycle" and through RPC, one
+ * at a time and pipelined, then fetches a full ADC capture through "md"
+ * and through RPC, and prints one line per measurement.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/rpc.h"
+
+#define CAPTURE_SAMPLES         16384   /* what md converts */
+
+static int fd;
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void die(const char *what) {
+
+  perror(what);
+  exit(1);
+}
+
+static void shellWrite(const char *s) {
+  size_t n = strlen(s);
+
+  while (n > 0) {
+    ssize_t w = write(fd, s, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      die("write");
+    }
+    s += w;
+    n -= w;
+  }
+}
+
+/*
+ * Reads until the prompt, returns the number of bytes read
+ */
+static unsigned long shellPrompt(void) {
+  static const char prompt[] = "ch> ";
+  unsigned long total = 0;
+  size_t got = 0;
+  char c;
+  ssize_t r;
+
+  while (got < sizeof(prompt) - 1) {
+    r = read(fd, &c, 1);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0) {
+      fprintf(stderr, "timeout\n");
+      exit(1);
+    }
+    total++;
+    if (c == prompt[got])
+      got++;
+    else
+      got = (c == prompt[0]);
+  }
+  return total;
+}
+
+static void report(const char *what, unsigned long n, double t) {
+
+  printf("%-24s %6lu calls  %9.1f calls/s  %8.1f us/call\n",
+         what, n, n / t, t / n * 1e6);
+}
+
+static void benchShellCycle(unsigned long rounds) {
+  char cmd[32];
+  unsigned long i;
+  double t0;
+
+  t0 = now();
+  for (i = 0; i < rounds; i++) {
+    snprintf(cmd, sizeof(cmd), "cycle %lu\r", i % 10000);
+    shellWrite(cmd);
+    shellPrompt();
+  }
+  report("shell cycle", rounds, now() - t0);
+}
+
+static void benchRpcPwm(RpcClient *c, unsigned long rounds) {
+  unsigned long i;
+  double t0;
+
+  t0 = now();
+  for (i = 0; i < rounds; i++)
+    if (rpcPwmSet(c, 0, i % 10000) != RPC_OK) {
+      fprintf(stderr, "rpc pwm set failed\n");
+      exit(1);
+    }
+  report("rpc pwm set", rounds, now() - t0);
+}
+
+static void benchRpcPwmPipelined(RpcClient *c, unsigned long rounds, unsigned window) {
+  unsigned long sent = 0, received = 0;
+  unsigned inFlight = 0;
+  RpcResponse r;
+  uint8_t p[5];
+  char what[32];
+  double t0;
+
+  t0 = now();
+  while (received < rounds) {
+    while (inFlight < window && sent < rounds) {
+      p[0] = 0;
+      rpcPut32(p + 1, sent % 10000);
+      if (rpcSend(c, RPC_OP_PWM_SET, p, sizeof(p)) < 0)
+        die("rpc send");
+      sent++;
+      inFlight++;
+    }
+    if (rpcReceive(c, &r, RPC_TIMEOUT_MS) < 0 || r.status != RPC_OK) {
+      fprintf(stderr, "rpc pwm set failed\n");
+      exit(1);
+    }
+    inFlight--;
+    received++;
+  }
+  snprintf(what, sizeof(what), "rpc pwm set window %u", window);
+  report(what, rounds, now() - t0);
+}
+
+static void benchShellCapture(void) {
+  unsigned long bytes;
+  double t0, t;
+
+  t0 = now();
+  shellWrite("md\r");
+  bytes = shellPrompt();
+  t = now() - t0;
+  printf("shell md                 %6u samples %9lu bytes  %8.1f ms\n",
+         CAPTURE_SAMPLES, bytes, t * 1e3);
+}
+
+static void benchRpcCapture(RpcClient *c) {
+  static uint16_t samples[CAPTURE_SAMPLES];
+  uint32_t sum, check = 0;
+  unsigned i;
+  int s;
+  double t0, t;
+
+  t0 = now();
+  s = rpcAdcCapture(c, CAPTURE_SAMPLES, &sum, NULL, NULL);
+  if (s == RPC_OK)
+    s = rpcAdcRead(c, 0, CAPTURE_SAMPLES, samples);
+  t = now() - t0;
+  if (s != RPC_OK) {
+    fprintf(stderr, "rpc capture failed (%d), is mc running?\n", s);
+    return;
+  }
+  for (i = 0; i < CAPTURE_SAMPLES; i++)
+    check += samples[i];
+  printf("rpc capture+read         %6u samples %9u bytes  %8.1f ms  %s\n",
+         CAPTURE_SAMPLES, CAPTURE_SAMPLES * 2, t * 1e3,
+         check == sum ? "sum ok" : "SUM MISMATCH");
+}
+
+int main(int argc, char *argv[]) {
+  const char *console = argc > 1 ? argv[1] : "/dev/ttyACM0";
+  const char *data = argc > 2 ? argv[2] : "/dev/ttyUSB0";
+  unsigned long rounds = argc > 3 ? strtoul(argv[3], NULL, 0) : 1000;
+  uint32_t stats[RPC_STAT_COUNT];
+  struct termios tio;
+  RpcClient rpc;
+
+  fd = open(console, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+    die(console);
+  if (tcgetattr(fd, &tio) < 0)
+    die("tcgetattr");
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 50;                 /* 5 s read timeout */
+  if (tcsetattr(fd, TCSANOW, &tio) < 0)
+    die("tcsetattr");
+  tcflush(fd, TCIOFLUSH);
+  if (rpcOpen(&rpc, data) < 0)
+    die(data);
+
+  /* get a fresh prompt, and check the server is there */
+  shellWrite("\r");
+  shellPrompt();
+  if (rpcPing(&rpc, "ping", 4) != RPC_OK) {
+    fprintf(stderr, "no answer from the RPC server\n");
+    return 1;
+  }
+
+  benchShellCycle(rounds);
+  benchRpcPwm(&rpc, rounds);
+  benchRpcPwmPipelined(&rpc, rounds, 4);
+  benchRpcPwmPipelined(&rpc, rounds, 16);
+  benchShellCapture();
+  benchRpcCapture(&rpc);
+
+  if (rpcStats(&rpc, stats) == RPC_OK)
+    printf("device: %u requests, %u crc errors, %u frame errors\n",
+           stats[RPC_STAT_REQUESTS], stats[RPC_STAT_CRC_ERRORS],
+           stats[RPC_STAT_FRAME_ERRORS]);
+  if (rpc.badFrames)
+    printf("host: %lu bad frames\n", rpc.badFrames);
+  rpcClose(&rpc);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Host side of the trace console command.
+ *
+ *   gcc -O2 -Wall -I. -o trace2json host/trace2json.c
+ *   ./trace2json [/dev/ttyACM0 | dump.bin] > trace.json
+ *
+ * Fetches the context switch and interrupt trace from the device (or reads
+ * a dump saved earlier, everything after the "TRACE <bytes>" line) and
+ * converts it to Chrome trace event JSON. Open it in chrome://tracing or
+ * https://ui.perfetto.dev, every thread and every traced interrupt gets a
+ * track of its own, so preemption shows as one track stopping while another
+ * one runs. The dump format is in myTraceProto.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "myTraceProto.h"
+
+/* ChibiOS 2.5 THD_STATE_NAMES */
+static const char *states[] = {
+  "READY", "CURRENT", "SUSPENDED", "WTSEM", "WTMTX", "WTCOND", "SLEEPING",
+  "WTEXIT", "WTOREVT", "WTANDEVT", "SNDMSGQ", "SNDMSG", "WTMSG", "WTQUEUE",
+  "FINAL"
+};
+
+#define MAX_THREADS     64
+#define IRQ_TID_BASE    1000
+
+typedef struct {
+  uint32_t addr;
+  uint32_t prio;
+  char name[TRACE_NAME_SIZE + 12];
+} TraceThread;
+
+static TraceThread threads[MAX_THREADS];
+static unsigned threadCount;
+static int fd;
+static int firstEvent = 1;
+
+static void die(const char *what) {
+
+  perror(what);
+  exit(1);
+}
+
+static void writeAll(int f, const void *buf, size_t n) {
+  const uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t w = write(f, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      die("write");
+    }
+    p += w;
+    n -= w;
+  }
+}
+
+static void readAll(int f, void *buf, size_t n) {
+  uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t r = read(f, p, n);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      die("read");
+    }
+    if (r == 0) {
+      fprintf(stderr, "timeout or short dump\n");
+      exit(1);
+    }
+    p += r;
+    n -= r;
+  }
+}
+
+/*
+ * Reads until the given text has been seen, shell echo and prompt are skipped
+ */
+static void waitFor(const char *text) {
+  size_t len = strlen(text), got = 0;
+  char c;
+
+  while (got < len) {
+    readAll(fd, &c, 1);
+    if (c == text[got])
+      got++;
+    else
+      got = (c == text[0]);
+  }
+}
+
+static int openRaw(const char *dev) {
+  struct termios tio;
+  int f;
+
+  f = open(dev, O_RDWR | O_NOCTTY);
+  if (f < 0)
+    die(dev);
+  if (tcgetattr(f, &tio) < 0)
+    die("tcgetattr");
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 50;                 /* 5 s read timeout */
+  if (tcsetattr(f, TCSANOW, &tio) < 0)
+    die("tcsetattr");
+  tcflush(f, TCIOFLUSH);
+  return f;
+}
+
+static uint32_t get32(const uint8_t *p) {
+
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void getName(char *dst, const uint8_t *p) {
+
+  memcpy(dst, p, TRACE_NAME_SIZE);
+  dst[TRACE_NAME_SIZE] = 0;
+}
+
+/*
+ * Track of a thread, threads that were gone at dump time get one too
+ */
+static unsigned threadTid(uint32_t addr) {
+  unsigned i;
+
+  for (i = 0; i < threadCount; i++)
+    if (threads[i].addr == addr)
+      return i + 1;
+  if (threadCount == MAX_THREADS) {
+    fprintf(stderr, "too many threads\n");
+    exit(1);
+  }
+  threads[threadCount].addr = addr;
+  snprintf(threads[threadCount].name, sizeof(threads[0].name), "0x%08x", addr);
+  return ++threadCount;
+}
+
+static void event(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void event(const char *fmt, ...) {
+  va_list ap;
+
+  printf(firstEvent ? "\n  " : ",\n  ");
+  firstEvent = 0;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+}
+
+static void slice(unsigned tid, const char *name, double ts, double dur,
+                  const char *argName, const char *arg) {
+
+  event("{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"%s\": \"%s\"}}",
+        name, tid, ts, dur, argName, arg);
+}
+
+int main(int argc, char *argv[]) {
+  const char *src = argc > 1 ? argv[1] : "/dev/ttyACM0";
+  uint8_t *dump, *p;
+  uint32_t freq, nthreads, nirqs, nevents, i;
+  char irqNames[256][TRACE_NAME_SIZE + 1];
+  char line[64];
+  unsigned long size = 0;
+  struct stat st;
+  uint64_t t0 = 0, runStart = 0, last = 0;
+  unsigned running = 0;
+  double us;
+
+  if (stat(src, &st) == 0 && S_ISREG(st.st_mode)) {
+    fd = open(src, O_RDONLY);
+    if (fd < 0)
+      die(src);
+    size = st.st_size;
+  }
+  else {
+    size_t n = 0;
+
+    fd = openRaw(src);
+    writeAll(fd, "\r", 1);
+    waitFor("ch> ");
+    writeAll(fd, "trace\r", 6);
+    waitFor("TRACE ");
+    do {
+      readAll(fd, &line[n], 1);
+    } while (line[n] != '\n' && ++n < sizeof(line) - 1);
+    line[n] = 0;
+    size = strtoul(line, NULL, 10);
+  }
+  if (size < TRACE_HEADER_SIZE) {
+    fprintf(stderr, "no trace\n");
+    return 1;
+  }
+  dump = malloc(size);
+  if (!dump)
+    die("malloc");
+  readAll(fd, dump, size);
+  close(fd);
+
+  if (get32(dump) != TRACE_MAGIC) {
+    fprintf(stderr, "not a trace dump\n");
+    return 1;
+  }
+  freq = get32(dump + 4);
+  nthreads = get32(dump + 8);
+  nirqs = get32(dump + 12);
+  nevents = get32(dump + 16);
+  if (size != TRACE_HEADER_SIZE + nthreads * TRACE_THREAD_SIZE +
+      nirqs * TRACE_IRQ_SIZE + nevents * (unsigned long)TRACE_EVENT_SIZE) {
+    fprintf(stderr, "dump size does not match its header\n");
+    return 1;
+  }
+  us = freq / 1e6;
+
+  p = dump + TRACE_HEADER_SIZE;
+  for (i = 0; i < nthreads && i < MAX_THREADS; i++, p += TRACE_THREAD_SIZE) {
+    threads[i].addr = get32(p);
+    threads[i].prio = get32(p + 4);
+    getName(threads[i].name, p + 8);
+    if (!threads[i].name[0])
+      snprintf(threads[i].name, sizeof(threads[0].name), "0x%08x", threads[i].addr);
+  }
+  threadCount = i;
+  p = dump + TRACE_HEADER_SIZE + nthreads * TRACE_THREAD_SIZE;
+  for (i = 0; i < 256; i++)
+    snprintf(irqNames[i], sizeof(irqNames[0]), "irq %u", i);
+  for (i = 0; i < nirqs; i++, p += TRACE_IRQ_SIZE)
+    getName(irqNames[get32(p) & 0xff], p + 4);
+
+  printf("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  event("{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+        "\"args\": {\"name\": \"STM32F4 %.0f MHz\"}}", us);
+
+  for (i = 0; i < nevents; i++, p += TRACE_EVENT_SIZE) {
+    uint64_t t = get32(p) | (uint64_t)get32(p + 4) << 32;
+    uint32_t arg = get32(p + 8);
+    uint8_t kind = p[12], info = p[13];
+
+    if (i == 0)
+      t0 = t;
+    if (kind == TRACE_KIND_SWITCH) {
+      unsigned tid = threadTid(arg);
+      if (running)
+        slice(running, threads[running - 1].name, (runStart - t0) / us,
+              (t - runStart) / us, "left",
+              info < sizeof(states) / sizeof(states[0]) ? states[info] : "?");
+      running = tid;
+      runStart = t;
+      last = t;
+    }
+    else if (kind == TRACE_KIND_IRQ) {
+      char cycles[16];
+
+      snprintf(cycles, sizeof(cycles), "%u", arg);
+      slice(IRQ_TID_BASE + info, irqNames[info], (t - t0) / us, arg / us,
+            "cycles", cycles);
+      if (t + arg > last)
+        last = t + arg;
+    }
+  }
+  /* the thread that was running when the dump was taken */
+  if (running && last > runStart)
+    slice(running, threads[running - 1].name, (runStart - t0) / us,
+          (last - runStart) / us, "left", "-");
+
+  for (i = 0; i < threadCount; i++) {
+    event("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+          "\"args\": {\"name\": \"%s\"}}", i + 1, threads[i].name);
+    event("{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+          "\"args\": {\"sort_index\": %u}}", i + 1, 1000 - threads[i].prio);
+  }
+  p = dump + TRACE_HEADER_SIZE + nthreads * TRACE_THREAD_SIZE;
+  for (i = 0; i < nirqs; i++, p += TRACE_IRQ_SIZE) {
+    event("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+          "\"args\": {\"name\": \"%s\"}}", IRQ_TID_BASE + (get32(p) & 0xff),
+          irqNames[get32(p) & 0xff]);
+    event("{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+          "\"args\": {\"sort_index\": %u}}", IRQ_TID_BASE + (get32(p) & 0xff), i);
+  }
+  printf("\n]}\n");
+  free(dump);
+  return 0;
+}
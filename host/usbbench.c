@@ -0,0 +1,237 @@
+/*
+ * Host side of the usbbench console command.
+ *
+ *   gcc -O2 -Wall -o usbbench host/usbbench.c
+ *   ./usbbench [/dev/ttyACM0] [bytes] [/dev/ttyUSB0]
+ *
+ * Measures the device to host throughput for several write sizes,
+ * the host to device throughput and the round trip latency of small
+ * messages, and prints one line per measurement.
+ * With a third argument the raw data goes through the data channel,
+ * which shows up as that device after
+ *   modprobe usbserial vendor=0x0483 product=0x5740
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LATENCY_ROUNDS  1000
+
+/* console and the device the raw data goes through, the same unless a
+   data channel device is given */
+static int fd, dfd;
+static const char *channel = "";
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void die(const char *what) {
+
+  perror(what);
+  exit(1);
+}
+
+static void writeAll(int f, const void *buf, size_t n) {
+  const uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t w = write(f, p, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      die("write");
+    }
+    p += w;
+    n -= w;
+  }
+}
+
+static void readAll(int f, void *buf, size_t n) {
+  uint8_t *p = buf;
+
+  while (n > 0) {
+    ssize_t r = read(f, p, n);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      die("read");
+    }
+    if (r == 0) {
+      fprintf(stderr, "timeout\n");
+      exit(1);
+    }
+    p += r;
+    n -= r;
+  }
+}
+
+/*
+ * Reads until the given text has been seen, shell echo and prompt are skipped
+ */
+static void waitFor(const char *text) {
+  size_t len = strlen(text), got = 0;
+  char c;
+
+  while (got < len) {
+    readAll(fd, &c, 1);
+    if (c == text[got])
+      got++;
+    else
+      got = (c == text[0]);
+  }
+}
+
+/*
+ * Reads the rest of the "BENCH END" line and the prompt after it
+ */
+static void readEnd(unsigned long *ms) {
+  char line[128];
+  size_t n = 0;
+
+  waitFor("BENCH END ");
+  do {
+    readAll(fd, &line[n], 1);
+  } while (line[n] != '\n' && ++n < sizeof(line) - 1);
+  line[n] = 0;
+  if (ms) {
+    unsigned long b = 0, t = 0;
+    sscanf(line, "%lu bytes %lu ms", &b, &t);
+    *ms = t;
+  }
+  waitFor("ch> ");
+}
+
+static void command(const char *fmt, unsigned long a, unsigned long b) {
+  char cmd[64];
+  char header[64];
+  int len;
+
+  len = snprintf(cmd, sizeof(cmd), fmt, a, b);
+  snprintf(cmd + len - 1, sizeof(cmd) - len + 1, "%s\r", channel);
+  writeAll(fd, cmd, strlen(cmd));
+  /* the mode is the second word of the command */
+  snprintf(header, sizeof(header), "BENCH %.*s %lu\r\n",
+           (int)strcspn(cmd + 9, " "), cmd + 9, a);
+  waitFor(header);
+}
+
+static void benchGen(unsigned long bytes, unsigned long chunk) {
+  uint8_t *buf = malloc(bytes);
+  unsigned long i, errors = 0, ms;
+  double t0, t;
+
+  command("usbbench gen %lu %lu\r", bytes, chunk);
+  t0 = now();
+  readAll(dfd, buf, bytes);
+  t = now() - t0;
+  for (i = 0; i < bytes; i++)
+    if (buf[i] != (uint8_t)i)
+      errors++;
+  readEnd(&ms);
+  printf("gen   chunk %4lu  %9lu bytes  %8.3f MB/s  %lu errors  (device %lu ms)\n",
+         chunk, bytes, bytes / t / 1e6, errors, ms);
+  free(buf);
+}
+
+static void benchSink(unsigned long bytes) {
+  uint8_t *buf = malloc(bytes);
+  unsigned long i, ms;
+  double t0, t;
+
+  for (i = 0; i < bytes; i++)
+    buf[i] = (uint8_t)i;
+  command("usbbench sink %lu %lu\r", bytes, 0);
+  t0 = now();
+  writeAll(dfd, buf, bytes);
+  readEnd(&ms);
+  t = now() - t0;
+  printf("sink             %9lu bytes  %8.3f MB/s  (device %lu ms)\n",
+         bytes, bytes / t / 1e6, ms);
+  free(buf);
+}
+
+static int cmpDouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void benchEcho(unsigned long size) {
+  static double rtt[LATENCY_ROUNDS];
+  uint8_t out[512], in[512];
+  unsigned long i;
+  double t0;
+
+  for (i = 0; i < size; i++)
+    out[i] = (uint8_t)i;
+  command("usbbench echo %lu %lu\r", size * LATENCY_ROUNDS, 0);
+  for (i = 0; i < LATENCY_ROUNDS; i++) {
+    t0 = now();
+    writeAll(dfd, out, size);
+    readAll(dfd, in, size);
+    rtt[i] = (now() - t0) * 1e6;
+  }
+  readEnd(NULL);
+  qsort(rtt, LATENCY_ROUNDS, sizeof(double), cmpDouble);
+  printf("echo  size  %4lu  rtt us  p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f\n",
+         size, rtt[LATENCY_ROUNDS / 2], rtt[LATENCY_ROUNDS * 9 / 10],
+         rtt[LATENCY_ROUNDS * 99 / 100], rtt[LATENCY_ROUNDS - 1]);
+}
+
+static int openRaw(const char *dev) {
+  struct termios tio;
+  int f;
+
+  f = open(dev, O_RDWR | O_NOCTTY);
+  if (f < 0)
+    die(dev);
+  if (tcgetattr(f, &tio) < 0)
+    die("tcgetattr");
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 50;                 /* 5 s read timeout */
+  if (tcsetattr(f, TCSANOW, &tio) < 0)
+    die("tcsetattr");
+  tcflush(f, TCIOFLUSH);
+  return f;
+}
+
+int main(int argc, char *argv[]) {
+  static const unsigned long chunks[] = {1, 16, 63, 64, 128, 512};
+  static const unsigned long sizes[] = {1, 16, 63, 64, 256};
+  const char *dev = argc > 1 ? argv[1] : "/dev/ttyACM0";
+  unsigned long bytes = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+  unsigned i;
+
+  fd = openRaw(dev);
+  dfd = fd;
+  if (argc > 3) {
+    dfd = openRaw(argv[3]);
+    channel = " data";
+  }
+
+  /* get a fresh prompt */
+  writeAll(fd, "\r", 1);
+  waitFor("ch> ");
+
+  for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    benchGen(bytes, chunks[i]);
+  benchSink(bytes);
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    benchEcho(sizes[i]);
+  if (dfd != fd)
+    close(dfd);
+  close(fd);
+  return 0;
+}
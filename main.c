@@ -32,41 +32,129 @@
 #include "myADC.h"
 #include "myUSB.h"
 #include "myMisc.h"
+#include "myStream.h"
+#include "myFormat.h"
+#include "myAudio.h"
+#include "myBench.h"
+#include "myData.h"
+#include "myRpc.h"
+#include "myProf.h"
+#include "myIrq.h"
+#include "myLoad.h"
+#include "myStack.h"
+#include "myTime.h"
+#include "myPool.h"
+#include "myTrace.h"
+#include "myRec.h"
+#include "myRaw.h"
+#include "myAwd.h"
+#include "myBus.h"
+#include "myFreq.h"
+#include "myDecim.h"
 
 
 
 
+/*
+ * Profiling wrappers, each command is timed by the prof command.
+ * Aliases share the wrapper and so the statistics.
+ */
+PROF_WRAP(cmd_mem)
+PROF_WRAP(cmd_threads)
+PROF_WRAP(cmd_toggle)
+PROF_WRAP(cmd_blinkspeed)
+PROF_WRAP(cmd_cycle)
+PROF_WRAP(cmd_ramp)
+PROF_WRAP(cmd_measure)
+PROF_WRAP(cmd_measureA)
+PROF_WRAP(cmd_measureSync)
+PROF_WRAP(cmd_Vref)
+PROF_WRAP(cmd_Temperature)
+PROF_WRAP(cmd_measureDirect)
+PROF_WRAP(cmd_measureCont)
+PROF_WRAP(cmd_measureRead)
+PROF_WRAP(cmd_measureStop)
+PROF_WRAP(cmd_stream)
+PROF_WRAP(cmd_fmtbench)
+PROF_WRAP(cmd_usbbench)
+PROF_WRAP(cmd_bench)
+#if MY_USE_USB_AUDIO
+PROF_WRAP(cmd_audio)
+#endif
+PROF_WRAP(cmd_boot)
+#if MY_USE_DATA_CHANNEL
+PROF_WRAP(cmd_data)
+PROF_WRAP(cmd_rpc)
+PROF_WRAP(cmd_raw)
+#endif
+PROF_WRAP(cmd_prof)
+PROF_WRAP(cmd_top)
+PROF_WRAP(cmd_stack)
+PROF_WRAP(cmd_ts)
+PROF_WRAP(cmd_trace)
+PROF_WRAP(cmd_rec)
+PROF_WRAP(cmd_awd)
+PROF_WRAP(cmd_bus)
+PROF_WRAP(cmd_freq)
+PROF_WRAP(cmd_decim)
+
 /*
  * assert Shell Commands to functions
  */
 
 static const ShellCommand commands[] = {
-  {"mem", cmd_mem},
-  {"threads", cmd_threads},
-  {"toggle", cmd_toggle},
-  {"t", cmd_toggle},
-  {"blinkspeed", cmd_blinkspeed},
-  {"bs", cmd_blinkspeed},
-  {"cycle", cmd_cycle},
-  {"c", cmd_cycle},
-  {"ramp", cmd_ramp},
-  {"r", cmd_ramp},
-  {"measure", cmd_measure},
-  {"m", cmd_measure},
-  {"measureAnalog", cmd_measureA},
-  {"ma", cmd_measureA},
-  {"vref", cmd_Vref},
-  {"v", cmd_Vref},
-  {"temperature", cmd_Temperature},
-  {"te", cmd_Temperature},
-  {"measureDirect", cmd_measureDirect},
-  {"md", cmd_measureDirect},
-  {"measureContinuous", cmd_measureCont},
-  {"mc", cmd_measureCont},
-  {"readContinuousData", cmd_measureRead},
-  {"rd", cmd_measureRead},
-  {"stopContinuous", cmd_measureStop},
-  {"sc", cmd_measureStop},
+  {"mem", PROF(cmd_mem)},
+  {"threads", PROF(cmd_threads)},
+  {"toggle", PROF(cmd_toggle)},
+  {"t", PROF(cmd_toggle)},
+  {"blinkspeed", PROF(cmd_blinkspeed)},
+  {"bs", PROF(cmd_blinkspeed)},
+  {"cycle", PROF(cmd_cycle)},
+  {"c", PROF(cmd_cycle)},
+  {"ramp", PROF(cmd_ramp)},
+  {"r", PROF(cmd_ramp)},
+  {"measure", PROF(cmd_measure)},
+  {"m", PROF(cmd_measure)},
+  {"measureAnalog", PROF(cmd_measureA)},
+  {"ma", PROF(cmd_measureA)},
+  {"measureSync", PROF(cmd_measureSync)},
+  {"ms", PROF(cmd_measureSync)},
+  {"vref", PROF(cmd_Vref)},
+  {"v", PROF(cmd_Vref)},
+  {"temperature", PROF(cmd_Temperature)},
+  {"te", PROF(cmd_Temperature)},
+  {"measureDirect", PROF(cmd_measureDirect)},
+  {"md", PROF(cmd_measureDirect)},
+  {"measureContinuous", PROF(cmd_measureCont)},
+  {"mc", PROF(cmd_measureCont)},
+  {"readContinuousData", PROF(cmd_measureRead)},
+  {"rd", PROF(cmd_measureRead)},
+  {"stopContinuous", PROF(cmd_measureStop)},
+  {"sc", PROF(cmd_measureStop)},
+  {"stream", PROF(cmd_stream)},
+  {"st", PROF(cmd_stream)},
+  {"fmtbench", PROF(cmd_fmtbench)},
+  {"usbbench", PROF(cmd_usbbench)},
+  {"bench", PROF(cmd_bench)},
+#if MY_USE_USB_AUDIO
+  {"audio", PROF(cmd_audio)},
+#endif
+  {"boot", PROF(cmd_boot)},
+  {"prof", PROF(cmd_prof)},
+  {"top", PROF(cmd_top)},
+  {"stack", PROF(cmd_stack)},
+  {"ts", PROF(cmd_ts)},
+  {"trace", PROF(cmd_trace)},
+  {"rec", PROF(cmd_rec)},
+  {"awd", PROF(cmd_awd)},
+  {"bus", PROF(cmd_bus)},
+  {"freq", PROF(cmd_freq)},
+  {"decim", PROF(cmd_decim)},
+#if MY_USE_DATA_CHANNEL
+  {"data", PROF(cmd_data)},
+  {"rpc", PROF(cmd_rpc)},
+  {"raw", PROF(cmd_raw)},
+#endif
   {NULL, NULL}
 };
 
@@ -75,10 +163,14 @@ static const ShellCommand commands[] = {
  * Shell configuration
  */
 
-#define SHELL_WA_SIZE   THD_WA_SIZE(2048)
+/*
+ * The shell always runs in this working area, a new shell is only
+ * started after the previous one has terminated
+ */
+static WORKING_AREA(waShell, 2048);
 
 static const ShellConfig shell_cfg1 = {
-  (BaseSequentialStream *)&SDU1,
+  (BaseSequentialStream *)&BSD1,
   commands
 };
 
@@ -91,6 +183,8 @@ int main(void) {
    * Shell thread
    */
   Thread *shelltp = NULL;
+  EventListener usbListener, shellListener;
+  eventmask_t events;
 
   /*
    * System initializations.
@@ -102,9 +196,25 @@ int main(void) {
   halInit();
   chSysInit();
 
+  /*
+   * The flight recorder and timestamps first, everything below may use
+   * them. Then the vector table to RAM, the stack analyser, the load
+   * monitor and the analog watchdog, which wrap some of the interrupt
+   * handlers
+   */
+  recInit();
+  tsInit();
+  irqInit();
+  stackInit();
+  loadInit();
+  awdInit();
+
   /*
    * Activate custom stuff
    */
+  poolInit();
+  busInit();
+  decimInit();
   mypwmInit();
   myADCinit();
 
@@ -118,19 +228,40 @@ int main(void) {
    */
   myUSBinit();
 
+  /*
+   * The shell talks through a buffer that coalesces output into full packets
+   */
+  bsObjectInit(&BSD1, (BaseSequentialStream *)&SDU1);
+
+#if MY_USE_DATA_CHANNEL
+  /*
+   * Binary RPC server and the raw sample stream on the data channel,
+   * next to the shell
+   */
+  rpcInit();
+  rawInit();
+#endif
 
   /*
-   * Main loop, does nothing except spawn a shell when the old one was terminated
+   * Main loop, does nothing except spawn a shell when the USB gets configured
+   * and collect it when it logs out. A USB reset or suspend wakes the shell
+   * with an end of file, so it logs out by itself.
    */
+  stackWatch("shell", waShell, sizeof(waShell));
+  chEvtRegisterMask(&usbEvents, &usbListener, EVENT_MASK(0));
+  chEvtRegisterMask(&shell_terminated, &shellListener, EVENT_MASK(1));
   while (TRUE) {
-    if (!shelltp && isUsbActive())
-      {
-        shelltp = shellCreate(&shell_cfg1, SHELL_WA_SIZE, NORMALPRIO);
-      }
-    else if (chThdTerminated(shelltp)) {
-      chThdRelease(shelltp);    /* Recovers memory of the previous shell.   */
+    if (!shelltp && isUsbActive()) {
+      shelltp = shellCreateStatic(&shell_cfg1, waShell, sizeof(waShell), NORMALPRIO);
+      usbShellStarted();
+    }
+    events = chEvtWaitAny(ALL_EVENTS);
+    if (events & EVENT_MASK(0))
+      chEvtGetAndClearFlags(&usbListener);
+    if ((events & EVENT_MASK(1)) && shelltp) {
+      chThdWait(shelltp);       /* The working area is free once it is gone.*/
+      stackScan();              /* Its worst case, before it is refilled.   */
       shelltp = NULL;           /* Triggers spawning of a new shell.        */
     }
-    chThdSleepMilliseconds(1000);
   }
 }
@@ -1,36 +1,81 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "ch.h"
 #include "hal.h"
 #include "chprintf.h"
 
 #include "myADC.h"
+#include "myFormat.h"
+#include "myAudio.h"
+#include "myTime.h"
+#include "myLoad.h"
+#include "myPool.h"
+#include "myRec.h"
+#include "myBus.h"
+#include "myAwd.h"
+#include "myPWM.h"
 
 
 
 /*
- * Global lock for the ADC.
- * I should probably use proper locking mechanisms provided by chibios!
+ * ADC arbitration: everything converts PC1 on ADC1. Two ADCs must not
+ * sample the same channel at overlapping times (RM0090, their sample and
+ * hold capacitors share the charge), so a one-shot conversion (measure,
+ * captures, oversampling, PWM synchronous, the RPC server) pauses a
+ * running continuous conversion and restarts it when done, which leaves
+ * a gap in the stream instead of refusing. One-shot requests queue in
+ * FIFO order on adcOneShot and give up after ADC_ONESHOT_TIMEOUT, the
+ * ADC1 bus lock serialises them with mc and sc.
  */
-int running=0;
+static bool_t running = FALSE;
+static bool_t paused = FALSE;
+static Semaphore adcOneShot;
+
+static void adcContStart(void);
+static void adcContStop(void);
+
+static bool_t adcOneShotAcquire(void) {
+
+  if (chSemWaitTimeout(&adcOneShot, ADC_ONESHOT_TIMEOUT) != RDY_OK)
+    return FALSE;
+  adcAcquireBus(&ADCD1);
+  if (running) {
+    paused = TRUE;
+    adcContStop();
+    recLog(REC_EV_ADC_STOP, 1, 0);
+  }
+  return TRUE;
+}
+
+static void adcOneShotRelease(void) {
+
+  if (paused) {
+    recLog(REC_EV_ADC_START, 1, 0);
+    adcContStart();
+    paused = FALSE;
+  }
+  adcReleaseBus(&ADCD1);
+  chSemSignal(&adcOneShot);
+}
+
+bool_t myADCrunning(void) {
+
+  return running;
+}
 
 
 /*
  * Defines for single scan conversion
  */
 #define ADC_GRP1_NUM_CHANNELS   1
-#define ADC_GRP1_BUF_DEPTH      2048*2*4
-
-/*
- * Buffer for single conversion
- */
-static adcsample_t samples1[ADC_GRP1_NUM_CHANNELS * ADC_GRP1_BUF_DEPTH];
+#define ADC_GRP1_BUF_DEPTH      ADC_CAPTURE_MAX
 
 /*
  * Defines for continuous scan conversions
  */
-#define ADC_GRP2_NUM_CHANNELS   10
-#define ADC_GRP2_BUF_DEPTH      1024
+#define ADC_GRP2_NUM_CHANNELS   ADC_CONT_NUM_CHANNELS
+#define ADC_GRP2_BUF_DEPTH      (2 * ADC_CONT_HALF_SEQUENCES)
 static adcsample_t samples2[ADC_GRP2_NUM_CHANNELS * ADC_GRP2_BUF_DEPTH];
 
 
@@ -42,7 +87,7 @@ static adcsample_t samples2[ADC_GRP2_NUM_CHANNELS * ADC_GRP2_BUF_DEPTH];
 /*
  * The measured Value is initialized to 2^16/3V*2.21V
  */
-uint32_t VREFMeasured = 26433;
+uint32_t VREFMeasured = ADC_PIPE_VREF_INIT;
 
 /*
  * second storage ring buffer for continuous scan
@@ -59,12 +104,11 @@ unsigned long temp[BUFFLEN];
  */
 static void adcerrorcallback(ADCDriver *adcp, adcerror_t err) {
 
-  (void)adcp;
-  (void)err;
-  if(running){
+  if(running && !paused){
     data[p1++]=0;
     overflow++;
-  }
+  }
+  recLog(REC_EV_ADC_ERROR, err, overflow);
 }
 
 /*
@@ -86,42 +130,270 @@ static const ADCConversionGroup adcgrpcfg1 = {
   ADC_SQR3_SQ1_N(ADC_CHANNEL_IN11)          //SQR3: Conversion group sequence 1...6
 };
 
+/*
+ * gives the blocks of a capture back to the pool
+ */
+void myADCrelease(AdcCapture *cp) {
+  size_t i;
+
+  for (i = 0; i < ADC_CAPTURE_BLOCKS; i++) {
+    if (cp->blocks[i])
+      poolFree(cp->blocks[i]);
+    cp->blocks[i] = NULL;
+  }
+  cp->n = 0;
+}
+
+/*
+ * single scan conversion of n samples into pool blocks, for the console
+ * commands and the RPC server. Every block is a conversion of its own, so
+ * there is a gap of a few us between blocks.
+ * Returns FALSE if n is too large, the pool has too few free blocks or
+ * the ADC did not become free in time, the capture holds nothing then.
+ */
+bool_t myADCcapture(AdcCapture *cp, size_t n) {
+  bool_t result = FALSE;
+  size_t i, len;
+
+  for (i = 0; i < ADC_CAPTURE_BLOCKS; i++)
+    cp->blocks[i] = NULL;
+  cp->n = 0;
+  if (n == 0 || n > ADC_GRP1_BUF_DEPTH)
+    return FALSE;
+  for (i = 0; i * POOL_BLOCK_SAMPLES < n; i++) {
+    cp->blocks[i] = poolAlloc();
+    if (!cp->blocks[i]) {
+      myADCrelease(cp);
+      return FALSE;
+    }
+  }
+  if (adcOneShotAcquire()) {
+    for (i = 0; i * POOL_BLOCK_SAMPLES < n; i++) {
+      len = n - i * POOL_BLOCK_SAMPLES;
+      if (len > POOL_BLOCK_SAMPLES)
+        len = POOL_BLOCK_SAMPLES;
+      adcConvert(&ADCD1, &adcgrpcfg1, cp->blocks[i], len);
+    }
+    cp->n = n;
+    result = TRUE;
+    adcOneShotRelease();
+  }
+  if (!result)
+    myADCrelease(cp);
+  return result;
+}
+
+/*
+ * Streaming oversampling: a circular conversion into a small buffer, the
+ * callback adds up every half of it into a 64 bit sum until enough
+ * samples have been taken. Same channel and sample time as the single
+ * scan conversion, without keeping the samples.
+ */
+#define ADC_OS_BUF_DEPTH        512
+#define ADC_OS_RATE             (STM32_PCLK2 / 4 / (3 + 12))
+static adcsample_t samplesOs[ADC_OS_BUF_DEPTH];
+
+static uint64_t adcOsSum;
+static uint32_t adcOsLeft;
+static bool_t adcOsStarted;
+static adcsample_t adcOsFirst;
+static Semaphore adcOsDone;
+
+static void adcOsCallback(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
+  uint32_t sum = 0;
+  size_t i;
+
+  (void)adcp;
+  if (adcOsLeft == 0)
+    return;
+  if (n > adcOsLeft)
+    n = adcOsLeft;
+  if (!adcOsStarted) {
+    adcOsFirst = buffer[0];
+    adcOsStarted = TRUE;
+  }
+  //at most 256 samples of 12 bit, no overflow
+  for (i = 0; i < n; i++)
+    sum += buffer[i];
+  adcOsSum += sum;
+  adcOsLeft -= n;
+  if (adcOsLeft == 0) {
+    chSysLockFromIsr();
+    chSemSignalI(&adcOsDone);
+    chSysUnlockFromIsr();
+  }
+}
+
+static const ADCConversionGroup adcgrpcfgOs = {
+  TRUE,                         //circular buffer mode
+  ADC_GRP1_NUM_CHANNELS,        //Number of the analog channels
+  adcOsCallback,                //Callback function
+  adcerrorcallback,             //Error callback
+  0,                                        /* CR1 */
+  ADC_CR2_SWSTART,                          /* CR2 */
+  ADC_SMPR1_SMP_AN11(ADC_SAMPLE_3),         //sample times ch10-18
+  0,                                        //sample times ch0-9
+  ADC_SQR1_NUM_CH(ADC_GRP1_NUM_CHANNELS),   //SQR1: Conversion group sequence 13...16 + sequence length
+  0,                                        //SQR2: Conversion group sequence 7...12
+  ADC_SQR3_SQ1_N(ADC_CHANNEL_IN11)          //SQR3: Conversion group sequence 1...6
+};
+
+/*
+ * Sum of n samples of PC1, any n up to 2^32-1 (2^20 take 0.75s).
+ * Returns FALSE if the ADC did not become free in time or the conversion
+ * failed, first gets the first sample if not NULL.
+ */
+bool_t myADCoversample(uint32_t n, uint64_t *sum, adcsample_t *first) {
+  bool_t result = FALSE;
+  msg_t msg;
+
+  if (n == 0)
+    return FALSE;
+  if (adcOneShotAcquire()) {
+    adcOsSum = 0;
+    adcOsLeft = n;
+    adcOsStarted = FALSE;
+    chSemReset(&adcOsDone, 0);
+    adcStartConversion(&ADCD1, &adcgrpcfgOs, samplesOs, ADC_OS_BUF_DEPTH);
+    msg = chSemWaitTimeout(&adcOsDone, n / (ADC_OS_RATE / CH_FREQUENCY) + MS2ST(100));
+    adcStopConversion(&ADCD1);
+    if (msg == RDY_OK) {
+      *sum = adcOsSum;
+      if (first)
+        *first = adcOsFirst;
+      result = TRUE;
+    }
+    adcOneShotRelease();
+  }
+  return result;
+}
+
+/*
+ * PWM synchronous sampling: TIM2_CC4 (see mypwmTrigger) starts one
+ * conversion per PWM period at a fixed phase. The buffer holds two
+ * samples, so the callback sees each one and tags it with the duty of
+ * channel 1 at that moment.
+ */
+#define ADC_SYNC_BUF_DEPTH      2
+static adcsample_t samplesSync[ADC_SYNC_BUF_DEPTH];
+
+static AdcSync *adcSync;
+static uint32_t adcSyncLeft;
+static Semaphore adcSyncDone;
+
+static void adcSyncCallback(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
+  AdcSync *s = adcSync;
+  pwmcnt_t duty = mypwmDuty();
+
+  (void)adcp;
+  (void)n;
+  if (adcSyncLeft == 0)
+    return;
+  if (s->n == 0) {
+    s->min = s->max = buffer[0];
+    s->duty = duty;
+  }
+  if (buffer[0] < s->min)
+    s->min = buffer[0];
+  if (buffer[0] > s->max)
+    s->max = buffer[0];
+  if (duty != s->duty)
+    s->dutyChanged++;
+  s->sum += buffer[0];
+  s->n++;
+  if (--adcSyncLeft == 0) {
+    chSysLockFromIsr();
+    chSemSignalI(&adcSyncDone);
+    chSysUnlockFromIsr();
+  }
+}
+
+static const ADCConversionGroup adcgrpcfgSync = {
+  TRUE,                         //circular buffer mode
+  ADC_GRP1_NUM_CHANNELS,        //Number of the analog channels
+  adcSyncCallback,              //Callback function
+  adcerrorcallback,             //Error callback
+  0,                                        /* CR1 */
+  ADC_CR2_EXTEN_FALLING | ADC_CR2_EXTSEL_SRC(ADC_SYNC_EXTSEL),   /* CR2 */
+  ADC_SMPR1_SMP_AN11(ADC_SAMPLE_3),         //sample times ch10-18
+  0,                                        //sample times ch0-9
+  ADC_SQR1_NUM_CH(ADC_GRP1_NUM_CHANNELS),   //SQR1: Conversion group sequence 13...16 + sequence length
+  0,                                        //SQR2: Conversion group sequence 7...12
+  ADC_SQR3_SQ1_N(ADC_CHANNEL_IN11)          //SQR3: Conversion group sequence 1...6
+};
+
+/*
+ * Samples PC1 at phase (PWM ticks into the period) in each of n PWM
+ * periods. Returns FALSE if the phase is out of the period, the ADC did not
+ * become free in time or the periods did not come.
+ */
+bool_t myADCsync(pwmcnt_t phase, uint32_t n, AdcSync *s) {
+  bool_t result = FALSE;
+  msg_t msg;
+
+  if (n == 0 || n > ADC_SYNC_MAX_PERIODS)
+    return FALSE;
+  memset(s, 0, sizeof(*s));
+  s->phase = phase;
+  if (adcOneShotAcquire()) {
+    if (mypwmTrigger(phase)) {
+      adcSync = s;
+      adcSyncLeft = n;
+      chSemReset(&adcSyncDone, 0);
+      adcStartConversion(&ADCD1, &adcgrpcfgSync, samplesSync, ADC_SYNC_BUF_DEPTH);
+      msg = chSemWaitTimeout(&adcSyncDone,
+                             MS2ST(n * 1000 / mypwmRate()) + MS2ST(100));
+      adcStopConversion(&ADCD1);
+      mypwmTriggerOff();
+      result = msg == RDY_OK;
+    }
+    adcOneShotRelease();
+  }
+  return result;
+}
+
+/*
+ * optional oversampling ratio of the measure commands
+ */
+static bool_t measureCount(BaseSequentialStream *chp, int argc, char *argv[],
+                           const char *name, uint32_t *n) {
+
+  *n = ADC_GRP1_BUF_DEPTH;
+  if (argc == 1)
+    *n = strtoul(argv[0], NULL, 0);
+  if (argc > 1 || *n == 0) {
+    chprintf(chp, "Usage: %s [samples]\r\n", name);
+    return FALSE;
+  }
+  return TRUE;
+}
+
 /*
  * console invocatable function for a single analog conversion
- * converts ADC_GRP1_BUF_DEPTH samples and averages them
- * with ADC_GRP1_BUF_DEPTH==2048 this gives around 14 bit precision
- * even though the ADC hardware has only 12 bits internal precision
- * also at 2048 samples the 14 bit are nearly noise free, while
- * each sample is very noisy.
- * WARNING: If you average to many samples, the variable containing
- *  the sum may overflow. That means that your readings will be wrong.
- * However: With the ADC delivering a max value of 2^12, with uint32_t
- *  you can average 2^20 = 1048576 samples.
+ * converts ADC_GRP1_BUF_DEPTH samples (or as many as given) and averages
+ * them. With 2048 samples this gives around 14 bit precision even though
+ * the ADC hardware has only 12 bits internal precision, also at 2048
+ * samples the 14 bit are nearly noise free, while each sample is very
+ * noisy. Every 4x more samples give another bit, the 64 bit sum does not
+ * overflow for any count.
  */
 void cmd_measure(BaseSequentialStream *chp, int argc, char *argv[]) {
 
-  (void)argv;
-  uint32_t sum=0;
-  unsigned int i;
-  if(running){
-    chprintf(chp, "Continuous measurement already running\r\n");
-    return;
-  }
-  if (argc >0 ) {
-    chprintf(chp, "Usage: measure\r\n");
+  uint64_t sum=0;
+  uint32_t n, avg;
+  adcsample_t first;
+  if (!measureCount(chp, argc, argv, "measure", &n))
     return;
-  }
 
-  adcConvert(&ADCD1, &adcgrpcfg1, samples1, ADC_GRP1_BUF_DEPTH);
-  //prints the first measured value
-  chprintf(chp, "Measured: %d  ", samples1[0]*16);
-  sum=0;
-  for (i=0;i<ADC_GRP1_BUF_DEPTH;i++){
-      //chprintf(chp, "%d  ", samples1[i]);
-      sum += samples1[i];
+  if (!myADCoversample(n, &sum, &first)) {
+    chprintf(chp, "ADC busy\r\n");
+    return;
   }
-  //prints the averaged value with two digits precision
-  chprintf(chp, "%U\r\n", sum/(ADC_GRP1_BUF_DEPTH/16));
+  //prints the first measured value
+  chprintf(chp, "Measured: %d  ", first*16);
+  //prints the averaged value scaled to 16 bit, with two decimals
+  avg = sum*1600/n;
+  chprintf(chp, "%U.%02U\r\n", avg/100, avg%100);
 }
 
  /*
@@ -130,21 +402,21 @@ void cmd_measure(BaseSequentialStream *chp, int argc, char *argv[]) {
 void cmd_measureDirect(BaseSequentialStream *chp, int argc, char *argv[]) {
 
   (void)argv;
+  AdcCapture capture;
   unsigned int i;
-  if(running){
-    chprintf(chp, "Continuous measurement already running\r\n");
-    return;
-  }
   if (argc >0 ) {
     chprintf(chp, "Usage: measure\r\n");
     return;
   }
-  adcConvert(&ADCD1, &adcgrpcfg1, samples1, ADC_GRP1_BUF_DEPTH);
-  chprintf(chp, "Measured:  ");
-  for (i=0;i<ADC_GRP1_BUF_DEPTH;i++){
-      chprintf(chp, "%d  ", samples1[i]);
+  if (!myADCcapture(&capture, ADC_GRP1_BUF_DEPTH)) {
+    chprintf(chp, "ADC busy or out of sample blocks\r\n");
+    return;
   }
+  chprintf(chp, "Measured:  ");
+  for (i=0;i<ADC_CAPTURE_BLOCKS;i++)
+    fmtWriteSamples(chp, capture.blocks[i], POOL_BLOCK_SAMPLES, "  ", FALSE);
   chprintf(chp, "\r\n");
+  myADCrelease(&capture);
 }
 
  /*
@@ -193,28 +465,19 @@ void cmd_Vref(BaseSequentialStream *chp, int argc, char *argv[]) {
 }
 
  /*
-  * averages ADC_GRP1_BUF_DEPTH samples and converts to analog voltage
+  * averages ADC_GRP1_BUF_DEPTH samples (or as many as given) and converts
+  * to analog voltage
   */
 void cmd_measureA(BaseSequentialStream *chp, int argc, char *argv[]) {
 
-  (void)argv;
-  uint32_t sum=0;
-  unsigned int i;
-  if(running){
-    chprintf(chp, "Continuous measurement already running\r\n");
+  uint64_t sum=0;
+  uint32_t n;
+  if (!measureCount(chp, argc, argv, "measureAnalog", &n))
     return;
-  }
-  if (argc >0 ) {
-    chprintf(chp, "Usage: measure\r\n");
+  if (!myADCoversample(n, &sum, NULL)) {
+    chprintf(chp, "ADC busy\r\n");
     return;
   }
-  //for(i=0;i<160;i++)
-  adcConvert(&ADCD1, &adcgrpcfg1, samples1, ADC_GRP1_BUF_DEPTH);
-  sum=0;
-  for (i=0;i<ADC_GRP1_BUF_DEPTH;i++){
-      //chprintf(chp, "%d  ", samples1[i]);
-      sum += samples1[i];
-  }
 
   /*
    * Conversion to 1/10mV: Max Value exuals ~3V
@@ -227,13 +490,118 @@ void cmd_measureA(BaseSequentialStream *chp, int argc, char *argv[]) {
 
   //Using VREFMeasured === VREFINT
   //sum = ((uint64_t)sum)/(ADC_GRP1_BUF_DEPTH/16)*VREFINT/VREFMeasured;
-  sum = ((uint64_t)sum)*VREFINT/(ADC_GRP1_BUF_DEPTH/16*VREFMeasured/100);
+  //at most 2^44 * 16 * 121 * 100 < 2^62
+  sum = sum*16*VREFINT*100/((uint64_t)n*VREFMeasured);
 
   //prints the averaged value with 4 digits precision
-  chprintf(chp, "Measured: %U.%04UV\r\n", sum/10000, sum%10000);
+  chprintf(chp, "Measured: %U.%04UV\r\n", (uint32_t)(sum/10000), (uint32_t)(sum%10000));
+}
+
+ /*
+  * samples PC1 at a fixed phase of the PWM period (in PWM ticks) and
+  * averages over ADC_SYNC_PERIODS periods (or as many as given), scaled
+  * to 16 bit like measure, with the duty of channel 1 at the time
+  */
+void cmd_measureSync(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  AdcSync s;
+  uint32_t n = ADC_SYNC_PERIODS, avg;
+  unsigned long phase;
+  if (argc < 1 || argc > 2) {
+    chprintf(chp, "Usage: measureSync phase [periods]\r\n");
+    return;
+  }
+  //range checked before it narrows to pwmcnt_t
+  phase = strtoul(argv[0], NULL, 0);
+  if (argc == 2)
+    n = strtoul(argv[1], NULL, 0);
+  if (phase == 0 || phase >= mypwmPeriod() || n == 0 || n > ADC_SYNC_MAX_PERIODS) {
+    chprintf(chp, "phase 1..%U, periods 1..%U\r\n", mypwmPeriod() - 1, ADC_SYNC_MAX_PERIODS);
+    return;
+  }
+  if (!myADCsync((pwmcnt_t)phase, n, &s)) {
+    chprintf(chp, "ADC busy or no PWM periods\r\n");
+    return;
+  }
+  avg = s.sum*1600/s.n;
+  chprintf(chp, "Measured: %U.%02U  min %U  max %U  at %U/%U, duty %U\r\n",
+           avg/100, avg%100, s.min*16, s.max*16, s.phase, mypwmPeriod(), s.duty);
+  if (s.dutyChanged)
+    chprintf(chp, "duty changed during %U periods\r\n", s.dutyChanged);
 }
 
 
+/*
+ * Receiver of every sequence of the continuous conversion, if any
+ */
+#if MY_USE_USB_AUDIO
+#define ADC_AUDIO               audioPush
+#else
+#define ADC_AUDIO               NULL
+#endif
+
+/*
+ * The reduction of adccallback without any side effects, for benchmarks
+ */
+uint32_t myADCreduce(const adcsample_t *buffer, size_t sequences) {
+
+  return adcPipeReduce(buffer, sequences, NULL);
+}
+
+/*
+ * Housekeeping of the continuous conversion: VREFINT and the temperature
+ * sensor are the injected group, started by a virtual timer every
+ * ADC_HK_PERIOD, so the regular sequence is PC1 only. The two conversions
+ * take 2*(480+12) ADC clocks (47us) and are long done when the timer
+ * comes back for the results. They are summed up until the next half
+ * buffer takes them.
+ */
+#define ADC_HK_PERIOD           MS2ST(10)
+#define ADC_JSQR_HK             ((1 << 20) |                        /* JL: 2 */ \
+                                 (ADC_CHANNEL_VREFINT << 10) |      /* JSQ3  */ \
+                                 (ADC_CHANNEL_SENSOR << 15))        /* JSQ4  */
+
+static VirtualTimer adcHkTimer;
+static AdcHousekeeping adcHk;
+static bool_t adcHkStarted;
+
+static void adcHkSample(void *arg) {
+
+  (void)arg;
+  chSysLockFromIsr();
+  if (adcHkStarted) {
+    adcHk.vrefLast = ADC1->JDR1;
+    adcHk.tempLast = ADC1->JDR2;
+    adcHk.vref += adcHk.vrefLast;
+    adcHk.temp += adcHk.tempLast;
+    adcHk.count++;
+  }
+  ADC1->CR2 |= ADC_CR2_JSWSTART;
+  adcHkStarted = TRUE;
+  chVTSetI(&adcHkTimer, ADC_HK_PERIOD, adcHkSample, NULL);
+  chSysUnlockFromIsr();
+}
+
+static void adcHkStart(void) {
+
+  ADC1->JSQR = ADC_JSQR_HK;
+  chSysLock();
+  adcHk.vref = 0;
+  adcHk.temp = 0;
+  adcHk.count = 0;
+  adcHkStarted = FALSE;
+  chVTSetI(&adcHkTimer, ADC_HK_PERIOD, adcHkSample, NULL);
+  chSysUnlock();
+}
+
+static void adcHkStop(void) {
+
+  chSysLock();
+  if (chVTIsArmedI(&adcHkTimer))
+    chVTResetI(&adcHkTimer);
+  chSysUnlock();
+}
+
 /*
  * This callback is called everytime the buffer is filled or half-filled
  * A second ring buffer is used to store the averaged data.
@@ -241,32 +609,41 @@ void cmd_measureA(BaseSequentialStream *chp, int argc, char *argv[]) {
  * I hope I understood how the Conversion ring buffer works...
  */
 
+/*
+ * time between two callbacks, i.e. between two half buffers
+ */
+static TsPeriod adcPeriod;
+
 static void adccallback(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
+  TS_START(start);
+  AdcHousekeeping hk;
+  AdcHalf h;
 
   (void)adcp;
-  (void)n;
-
-  unsigned int i,j;
-  uint32_t sum=0;
-  uint32_t vrefSum=0;
-  uint32_t tempSum=0;
-  if(n != ADC_GRP2_BUF_DEPTH/2) overflow++;
-  for(i=0;i<ADC_GRP2_BUF_DEPTH/2;i++){
-    for (j=0;j<8;j++){
-      sum+=buffer[i*ADC_GRP2_NUM_CHANNELS+j];
-    }
-    vrefSum +=buffer[i*ADC_GRP2_NUM_CHANNELS+8];
-    tempSum +=buffer[i*ADC_GRP2_NUM_CHANNELS+9];
+  tsPeriodUpdate(&adcPeriod);
+  recLog(REC_EV_ADC_HALF, n, p1);
+  if(n != ADC_GRP2_BUF_DEPTH/2){
+    overflow++;
+    recLog(REC_EV_ADC_OVERFLOW, overflow, p1);
   }
-  vref[p1] = vrefSum/(ADC_GRP2_BUF_DEPTH/4/8);
-  temp[p1] = tempSum/(ADC_GRP2_BUF_DEPTH/4/8);
-  data[p1] = sum/(ADC_GRP2_BUF_DEPTH/4);
-
-  // Only propagate 1/4th of the measured value to average VREF further
-  VREFMeasured = (VREFMeasured*3+vref[p1])>>2;
+  chSysLockFromIsr();
+  hk = adcHk;
+  adcHk.vref = 0;
+  adcHk.temp = 0;
+  adcHk.count = 0;
+  chSysUnlockFromIsr();
+  adcPipeHalf(buffer, ADC_GRP2_BUF_DEPTH/2, &hk, &VREFMeasured, &h, ADC_AUDIO);
+  busPublish(buffer, ADC_GRP2_BUF_DEPTH/2, &hk, &h);
+  vref[p1] = h.vref;
+  temp[p1] = h.temp;
+  data[p1] = h.data;
   ++p1;
   p1 = p1%BUFFLEN;
-  if(p1==p2) ++overflow;
+  if(p1==p2){
+    ++overflow;
+    recLog(REC_EV_ADC_OVERFLOW, overflow, p1);
+  }
+  loadIrq(LOAD_IRQ_ADC, TS_ELAPSED(start));
 }
 
 
@@ -277,18 +654,34 @@ static const ADCConversionGroup adcgrpcfg2 = {
   adcerrorcallback,         //Error callback
   0,                        /* CR1 */
   ADC_CR2_SWSTART,          /* CR2 */
+  //the injected housekeeping group uses the sensor and VREF sample times
   ADC_SMPR1_SMP_AN12(ADC_SAMPLE_480) | ADC_SMPR1_SMP_AN11(ADC_SAMPLE_480) |
   ADC_SMPR1_SMP_SENSOR(ADC_SAMPLE_480) | ADC_SMPR1_SMP_VREF(ADC_SAMPLE_480),  //sample times ch10-18
   0,                                                                        //sample times ch0-9
   ADC_SQR1_NUM_CH(ADC_GRP2_NUM_CHANNELS),                                   //SQR1: Conversion group sequence 13...16 + sequence length
-//  ADC_SQR2_SQ8_N(ADC_CHANNEL_IN11)   | ADC_SQR2_SQ7_N(ADC_CHANNEL_IN11),    //SQR2: Conversion group sequence 7...12
-  ADC_SQR2_SQ10_N(ADC_CHANNEL_SENSOR) | ADC_SQR2_SQ9_N(ADC_CHANNEL_VREFINT) |
-  ADC_SQR2_SQ8_N(ADC_CHANNEL_IN11)   | ADC_SQR2_SQ7_N(ADC_CHANNEL_IN11) ,
+  ADC_SQR2_SQ8_N(ADC_CHANNEL_IN11)   | ADC_SQR2_SQ7_N(ADC_CHANNEL_IN11),    //SQR2: Conversion group sequence 7...12
   ADC_SQR3_SQ6_N(ADC_CHANNEL_IN11)   | ADC_SQR3_SQ5_N(ADC_CHANNEL_IN11) |
   ADC_SQR3_SQ4_N(ADC_CHANNEL_IN11)   | ADC_SQR3_SQ3_N(ADC_CHANNEL_IN11) |
   ADC_SQR3_SQ2_N(ADC_CHANNEL_IN11)   | ADC_SQR3_SQ1_N(ADC_CHANNEL_IN11)     //SQR3: Conversion group sequence 1...6
 };
 
+/*
+ * Starts and stops the continuous conversion with its housekeeping and
+ * watchdog, under the ADC1 bus lock
+ */
+static void adcContStart(void) {
+
+  adcStartConversion(&ADCD1, &adcgrpcfg2, samples2, ADC_GRP2_BUF_DEPTH);
+  adcHkStart();
+  awdArm();
+}
+
+static void adcContStop(void) {
+
+  adcHkStop();
+  adcStopConversion(&ADCD1);
+}
+
 /*
  * Start a continuous conversion
  */
@@ -297,12 +690,16 @@ void cmd_measureCont(BaseSequentialStream *chp, int argc, char *argv[]) {
   (void)chp;
   (void)argc;
   (void)argv;
+  //one-shot conversions pause it under the same bus lock
+  adcAcquireBus(&ADCD1);
   if(running){
     chprintf(chp, "Continuous measurement already running\r\n");
   }else {
-    running=1;
-    adcStartConversion(&ADCD1, &adcgrpcfg2, samples2, ADC_GRP2_BUF_DEPTH);
+    running=TRUE;
+    recLog(REC_EV_ADC_START, 0, 0);
+    adcContStart();
   }
+  adcReleaseBus(&ADCD1);
 }
 
 /*
@@ -313,10 +710,13 @@ void cmd_measureStop(BaseSequentialStream *chp, int argc, char *argv[]) {
   (void)chp;
   (void)argc;
   (void)argv;
+  adcAcquireBus(&ADCD1);
   if(running){
-    adcStopConversion(&ADCD1);
-    running=0;
+    adcContStop();
+    running=FALSE;
+    recLog(REC_EV_ADC_STOP, 0, 0);
   }
+  adcReleaseBus(&ADCD1);
 }
 
 /*
@@ -324,12 +724,25 @@ void cmd_measureStop(BaseSequentialStream *chp, int argc, char *argv[]) {
  */
 void cmd_measureRead(BaseSequentialStream *chp, int argc, char *argv[]) {
 
+  char line[4*(FMT_U32_MAXLEN+1)+1];
+  size_t n;
   (void)chp;
   (void)argc;
   (void)argv;
   while(p1!=p2){
-    chprintf(chp, "%U:%U-%U-%U  ", p2, data[p2], vref[p2], temp[p2]);
+    //same as chprintf(chp, "%U:%U-%U-%U  ", ...) without the format parsing
+    n = fmtU32(line, p2);
+    line[n++] = ':';
+    n += fmtU32(line+n, data[p2]);
+    line[n++] = '-';
+    n += fmtU32(line+n, vref[p2]);
+    line[n++] = '-';
+    n += fmtU32(line+n, temp[p2]);
+    line[n++] = ' ';
+    line[n++] = ' ';
+    chSequentialStreamWrite(chp, (const uint8_t *)line, n);
     if (data[p2]==0){
+      recLog(REC_EV_ADC_READ_ERROR, p2, data[p2]);
       chprintf(chp, "\r\n Error!\r\n  ", p2, data[p2]);
     }
     p2 = (p2+1)%BUFFLEN;
@@ -345,6 +758,10 @@ void myADCinit(void){
   palSetGroupMode(GPIOC, PAL_PORT_BIT(1),
                   0, PAL_MODE_INPUT_ANALOG);
   adcStart(&ADCD1, NULL);
+  chSemInit(&adcOneShot, 1);
   //enable temperature sensor and Vref
   adcSTM32EnableTSVREFE();
+  chSemInit(&adcOsDone, 0);
+  chSemInit(&adcSyncDone, 0);
+  tsWatch(&adcPeriod, "adc");
 }
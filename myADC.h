@@ -1,16 +1,86 @@
 #ifndef MYADC_H_INCLUDED
 #define MYADC_H_INCLUDED
 
+#include "myPool.h"
+#include "myADCPipe.h"
+
+/*
+ * Rate of complete sequences in continuous mode [Hz]:
+ * ADC clock is PCLK2/4 (STM32_ADC_ADCPRE), 8 channels of 480+12 cycles each.
+ * The injected housekeeping conversions take another 0.5% of the ADC
+ * clock and stretch the sequences they fall into.
+ */
+#define ADC_CONT_SEQ_RATE   (STM32_PCLK2 / 4 / (ADC_CONT_NUM_CHANNELS * (480 + 12)))
+
+/*
+ * Sequences per half buffer of the continuous conversion, the callback
+ * gets them (and the audio stream their samples) in one go
+ */
+#define ADC_CONT_HALF_SEQUENCES 512
+
+/*
+ * Most samples a single scan conversion can take
+ */
+#define ADC_CAPTURE_MAX     (2048*2*4)
+
+/*
+ * Longest a one-shot conversion waits for the ADC before it gives up
+ */
+#define ADC_ONESHOT_TIMEOUT MS2ST(2000)
+
+/*
+ * PWM synchronous sampling: TIM2_CC4 is external trigger 5 of the regular
+ * group, periods averaged if none are given and the most
+ */
+#define ADC_SYNC_EXTSEL     5
+#define ADC_SYNC_PERIODS    100
+#define ADC_SYNC_MAX_PERIODS 65536
+
+typedef struct {
+  uint32_t n;                           /* periods sampled                  */
+  uint64_t sum;
+  adcsample_t min, max;
+  pwmcnt_t phase;                       /* PWM ticks into the period        */
+  pwmcnt_t duty;                        /* channel 1 width at the start     */
+  uint32_t dutyChanged;                 /* samples taken at another width   */
+} AdcSync;
+
+/*
+ * A single scan capture, held in sample blocks from the pool
+ */
+#define ADC_CAPTURE_BLOCKS  (ADC_CAPTURE_MAX / POOL_BLOCK_SAMPLES)
+
+typedef struct {
+  adcsample_t *blocks[ADC_CAPTURE_BLOCKS];
+  size_t n;
+} AdcCapture;
+
+#define ADC_CAPTURE_AT(cp, i) \
+  ((cp)->blocks[(i) / POOL_BLOCK_SAMPLES][(i) % POOL_BLOCK_SAMPLES])
+
+/*
+ * State of the continuous conversion, see myADC.c
+ */
+extern unsigned int overflow;
+extern uint32_t VREFMeasured;
+
 void cmd_measure(BaseSequentialStream *chp, int argc, char *argv[]);
 void cmd_measureA(BaseSequentialStream *chp, int argc, char *argv[]);
+void cmd_measureSync(BaseSequentialStream *chp, int argc, char *argv[]);
 void cmd_measureDirect(BaseSequentialStream *chp, int argc, char *argv[]);
-void cmd_Vref(BaseSequentialStream *chp, int argc, char *argv[]);
-void cmd_Temperature(BaseSequentialStream *chp, int argc, char *argv[]);
+void cmd_Vref(BaseSequentialStream *chp, int argc, char *argv[]);
+void cmd_Temperature(BaseSequentialStream *chp, int argc, char *argv[]);
 
 void cmd_measureCont(BaseSequentialStream *chp, int argc, char *argv[]);
-void cmd_measureRead(BaseSequentialStream *chp, int argc, char *argv[]);
-void cmd_measureStop(BaseSequentialStream *chp, int argc, char *argv[]);
+void cmd_measureRead(BaseSequentialStream *chp, int argc, char *argv[]);
+void cmd_measureStop(BaseSequentialStream *chp, int argc, char *argv[]);
 
+bool_t myADCcapture(AdcCapture *cp, size_t n);
+void myADCrelease(AdcCapture *cp);
+bool_t myADCoversample(uint32_t n, uint64_t *sum, adcsample_t *first);
+bool_t myADCsync(pwmcnt_t phase, uint32_t n, AdcSync *s);
+uint32_t myADCreduce(const adcsample_t *buffer, size_t sequences);
+bool_t myADCrunning(void);
 void myADCinit(void);
 
 
@@ -0,0 +1,95 @@
+#ifndef MYADCPIPE_H_INCLUDED
+#define MYADCPIPE_H_INCLUDED
+
+/*
+ * Half buffer processing of the continuous conversion: the reduction and
+ * scaling of adccallback and the VREFMeasured tracking.
+ * Plain C without ChibiOS dependencies, so host/replay runs the very same
+ * code on recorded captures and gets the same numbers bit for bit.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Samples per sequence in continuous mode: 8 x PC1. VREFINT and the
+ * temperature sensor are converted separately, see AdcHousekeeping.
+ */
+#define ADC_CONT_NUM_CHANNELS 8
+
+/*
+ * VREFMeasured at startup, 2^16/3V*1.21V
+ */
+#define ADC_PIPE_VREF_INIT      26433
+
+/*
+ * VREFINT and temperature conversions that came in during one half buffer
+ */
+typedef struct {
+  uint32_t vref;                        /* sums                             */
+  uint32_t temp;
+  uint16_t count;
+  uint16_t vrefLast;                    /* latest ones, used if count is 0  */
+  uint16_t tempLast;
+} AdcHousekeeping;
+
+/*
+ * Result of one half buffer, scaled to 16 bit (12 bit samples times 16)
+ */
+typedef struct {
+  uint32_t data;
+  uint32_t vref;
+  uint32_t temp;
+} AdcHalf;
+
+typedef void (*adcaudio_t)(int16_t sample);
+
+/*
+ * Sums up complete sequences, optionally feeding every sequence to the
+ * USB audio stream on the way.
+ * Inlined with a constant audio function (or NULL), so every caller gets
+ * its own loop.
+ */
+static inline uint32_t adcPipeReduce(const uint16_t *buffer, size_t sequences,
+                                     adcaudio_t audio) {
+  unsigned int i,j;
+  uint32_t sum=0;
+  uint32_t seqSum;
+
+  for(i=0;i<sequences;i++){
+    seqSum=0;
+    for (j=0;j<ADC_CONT_NUM_CHANNELS;j++){
+      seqSum+=buffer[i*ADC_CONT_NUM_CHANNELS+j];
+    }
+    sum+=seqSum;
+    //8 samples of 12 bit make 15 bit, shifted to signed 16 bit PCM
+    if (audio)
+      audio((int16_t)((int32_t)(seqSum*2)-32768));
+  }
+  return sum;
+}
+
+/*
+ * Everything adccallback computes from one half buffer of sequences
+ * (a multiple of 2) and the housekeeping conversions that came with it,
+ * vrefMeasured is updated in place
+ */
+static inline void adcPipeHalf(const uint16_t *buffer, size_t sequences,
+                               const AdcHousekeeping *hk,
+                               uint32_t *vrefMeasured, AdcHalf *out,
+                               adcaudio_t audio) {
+
+  out->data = adcPipeReduce(buffer, sequences, audio)/(sequences/2);
+  if (hk->count == 0) {
+    out->vref = hk->vrefLast*16;
+    out->temp = hk->tempLast*16;
+    return;
+  }
+  out->vref = hk->vref*16/hk->count;
+  out->temp = hk->temp*16/hk->count;
+
+  // Only propagate 1/4th of the measured value to average VREF further
+  *vrefMeasured = (*vrefMeasured*3+out->vref)>>2;
+}
+
+#endif // MYADCPIPE_H_INCLUDED
@@ -0,0 +1,128 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myAudio.h"
+
+#if MY_USE_USB_AUDIO
+
+/*
+ * Samples waiting for the host and the packet currently being sent
+ */
+static ApktState apkt;
+static int16_t packet[APKT_MAX_SAMPLES(AUDIO_SAMPLE_RATE)];
+
+/*
+ * Alternate setting of the streaming interface, 1 means the host listens
+ */
+static uint8_t altSetting;
+static uint32_t sent;
+
+static void audioTransmitted(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+  sent++;
+}
+
+/**
+ * @brief   IN EP3 state.
+ */
+static USBInEndpointState ep3instate;
+
+/**
+ * @brief   EP3 initialization structure (isochronous IN only).
+ */
+static const USBEndpointConfig ep3config = {
+  USB_EP_MODE_TYPE_ISOC,
+  NULL,
+  audioTransmitted,
+  NULL,
+  AUDIO_PACKET_SIZE,
+  0x0000,
+  &ep3instate,
+  NULL,
+  NULL
+};
+
+/*
+ * Called from the ADC callback for every conversion sequence
+ */
+void audioPush(int16_t sample) {
+
+  apktPush(&apkt, sample);
+}
+
+/*
+ * Called from the CONFIGURED event with the system locked
+ */
+void audioConfigureHookI(USBDriver *usbp) {
+
+  usbInitEndpointI(usbp, AUDIO_EP, &ep3config);
+  altSetting = 0;
+  apktInit(&apkt, AUDIO_SAMPLE_RATE, AUDIO_BURST);
+}
+
+/*
+ * The core leaves SET_INTERFACE and GET_INTERFACE to the class hook,
+ * selecting alternate setting 1 starts the stream.
+ */
+bool_t audioRequestsHook(USBDriver *usbp) {
+
+  if ((usbp->setup[0] & (USB_RTYPE_TYPE_MASK | USB_RTYPE_RECIPIENT_MASK)) !=
+      (USB_RTYPE_TYPE_STD | USB_RTYPE_RECIPIENT_INTERFACE))
+    return FALSE;
+  if (usbp->setup[4] != AUDIO_STREAMING_INTERFACE)
+    return FALSE;
+  switch (usbp->setup[1]) {
+  case USB_REQ_SET_INTERFACE:
+    altSetting = usbp->setup[2];
+    usbSetupTransfer(usbp, NULL, 0, NULL);
+    return TRUE;
+  case USB_REQ_GET_INTERFACE:
+    usbSetupTransfer(usbp, &altSetting, 1, NULL);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+ * Start of frame, every 1 ms: queue the next packet if the last one is gone
+ */
+void audioSofHook(USBDriver *usbp) {
+  uint32_t n;
+  bool_t busy;
+
+  chSysLockFromIsr();
+  busy = usbGetTransmitStatusI(usbp, AUDIO_EP);
+  chSysUnlockFromIsr();
+  if (altSetting == 0 || busy)
+    return;
+  n = apktFill(&apkt, packet);
+  usbPrepareTransmit(usbp, AUDIO_EP, (const uint8_t *)packet,
+                     n * sizeof(int16_t));
+  chSysLockFromIsr();
+  usbStartTransmitI(usbp, AUDIO_EP);
+  chSysUnlockFromIsr();
+}
+
+/*
+ * prints the state of the audio stream
+ */
+void cmd_audio(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: audio\r\n");
+    return;
+  }
+  chprintf(chp, "streaming  : %s\r\n", altSetting ? "yes" : "no");
+  chprintf(chp, "rate       : %U Hz\r\n", apkt.rate);
+  chprintf(chp, "fifo       : %U/%U\r\n", apktLevel(&apkt), APKT_FIFO_SIZE);
+  chprintf(chp, "packets    : %U (%U sent)\r\n", apkt.packets, sent);
+  chprintf(chp, "adjusted   : +%U -%U\r\n", apkt.longer, apkt.shorter);
+  chprintf(chp, "underruns  : %U\r\n", apkt.underruns);
+  chprintf(chp, "overruns   : %U\r\n", apkt.overruns);
+}
+
+#endif /* MY_USE_USB_AUDIO */
@@ -0,0 +1,45 @@
+#ifndef MYAUDIO_H_INCLUDED
+#define MYAUDIO_H_INCLUDED
+
+/*
+ * Optional USB Audio Class 1 input interface, streams IN11 from the
+ * continuous conversion as 16 bit mono PCM. Enable with USE_USB_AUDIO=yes.
+ */
+#if !defined(MY_USE_USB_AUDIO)
+#define MY_USE_USB_AUDIO                FALSE
+#endif
+
+#if MY_USE_USB_AUDIO
+
+#include "myADC.h"
+#include "myAudioPkt.h"
+
+/*
+ * The isochronous endpoint, the CDC OUT endpoint moves from EP3 to EP1
+ */
+#define AUDIO_EP                        3
+
+#define AUDIO_CONTROL_INTERFACE         2
+#define AUDIO_STREAMING_INTERFACE       3
+
+/*
+ * One PCM sample per continuous conversion sequence
+ */
+#define AUDIO_SAMPLE_RATE               ADC_CONT_SEQ_RATE
+#define AUDIO_PACKET_SIZE               (APKT_MAX_SAMPLES(AUDIO_SAMPLE_RATE) * 2)
+
+/*
+ * Samples pushed at once, a half buffer of the continuous conversion
+ */
+#define AUDIO_BURST                     ADC_CONT_HALF_SEQUENCES
+
+void audioPush(int16_t sample);
+void audioConfigureHookI(USBDriver *usbp);
+bool_t audioRequestsHook(USBDriver *usbp);
+void audioSofHook(USBDriver *usbp);
+
+void cmd_audio(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif /* MY_USE_USB_AUDIO */
+
+#endif // MYAUDIO_H_INCLUDED
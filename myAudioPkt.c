@@ -0,0 +1,76 @@
+#include "myAudioPkt.h"
+
+
+void apktInit(ApktState *ap, uint32_t rate, uint32_t burst) {
+
+  ap->wr = 0;
+  ap->rd = 0;
+  ap->rate = rate;
+  ap->target = burst;
+  ap->band = burst / 2 + APKT_FIFO_MARGIN;
+  ap->acc = 0;
+  ap->last = 0;
+  ap->packets = 0;
+  ap->underruns = 0;
+  ap->overruns = 0;
+  ap->longer = 0;
+  ap->shorter = 0;
+}
+
+uint32_t apktLevel(const ApktState *ap) {
+
+  return (ap->wr - ap->rd) & (2 * APKT_FIFO_SIZE - 1);
+}
+
+/*
+ * Producer side, a full FIFO drops the new sample
+ * (the read index belongs to the consumer)
+ */
+void apktPush(ApktState *ap, int16_t sample) {
+  uint32_t wr = ap->wr;
+
+  if (apktLevel(ap) >= APKT_FIFO_SIZE) {
+    ap->overruns++;
+    return;
+  }
+  ap->fifo[wr & (APKT_FIFO_SIZE - 1)] = sample;
+  ap->wr = (wr + 1) & (2 * APKT_FIFO_SIZE - 1);
+}
+
+/*
+ * Consumer side, called once per USB frame.
+ * Writes the next packet to out (at least APKT_MAX_SAMPLES(rate) entries)
+ * and returns the number of samples in it.
+ */
+uint32_t apktFill(ApktState *ap, int16_t *out) {
+  uint32_t n, i, level, rd;
+
+  ap->acc += ap->rate;
+  n = ap->acc / 1000;
+  ap->acc %= 1000;
+
+  level = apktLevel(ap);
+  if (level > ap->target + ap->band) {
+    n++;
+    ap->longer++;
+  }
+  else if (level + ap->band < ap->target && n > 0) {
+    n--;
+    ap->shorter++;
+  }
+
+  rd = ap->rd;
+  for (i = 0; i < n; i++) {
+    if (level > 0) {
+      ap->last = ap->fifo[rd & (APKT_FIFO_SIZE - 1)];
+      rd = (rd + 1) & (2 * APKT_FIFO_SIZE - 1);
+      level--;
+    }
+    else
+      ap->underruns++;
+    out[i] = ap->last;
+  }
+  ap->rd = rd;
+  ap->packets++;
+  return n;
+}
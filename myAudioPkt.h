@@ -0,0 +1,57 @@
+#ifndef MYAUDIOPKT_H_INCLUDED
+#define MYAUDIOPKT_H_INCLUDED
+
+/*
+ * Packetizer for the USB audio stream.
+ * Plain C without ChibiOS dependencies, so it can be built natively.
+ *
+ * One side pushes samples at whatever rate the ADC really runs, in bursts
+ * of up to burst samples (a half buffer of the continuous conversion),
+ * the other side takes one packet per 1 ms USB frame. The FIFO level then
+ * saws between a low point and that plus a burst. The packet size follows
+ * the nominal rate and is nudged by one sample when the level leaves a
+ * band of a burst plus margins, centred on one burst of fill, so the two
+ * clocks never run apart and the saw alone never triggers a nudge.
+ */
+
+#include <stdint.h>
+
+/*
+ * FIFO size in samples, must be a power of two and hold the band
+ * (2 * burst + 2 * APKT_FIFO_MARGIN) with room to spare
+ */
+#define APKT_FIFO_SIZE          2048
+/*
+ * How far the level may go beyond the saw of the bursts before packets
+ * are resized
+ */
+#define APKT_FIFO_MARGIN        64
+
+typedef struct {
+  int16_t fifo[APKT_FIFO_SIZE];
+  volatile uint32_t wr;                 /* only written by apktPush         */
+  volatile uint32_t rd;                 /* only written by apktFill         */
+  uint32_t rate;                        /* nominal rate [Hz]                */
+  uint32_t target;                      /* centre of the band, one burst    */
+  uint32_t band;                        /* half width of the band           */
+  uint32_t acc;                         /* fractional samples per frame     */
+  int16_t last;                         /* repeated on underrun             */
+  /* statistics */
+  uint32_t packets;
+  uint32_t underruns;
+  uint32_t overruns;
+  uint32_t longer;
+  uint32_t shorter;
+} ApktState;
+
+/*
+ * Largest packet apktFill can produce for a given rate, in samples
+ */
+#define APKT_MAX_SAMPLES(rate)  (((rate) + 999) / 1000 + 1)
+
+void apktInit(ApktState *ap, uint32_t rate, uint32_t burst);
+void apktPush(ApktState *ap, int16_t sample);
+uint32_t apktLevel(const ApktState *ap);
+uint32_t apktFill(ApktState *ap, int16_t *out);
+
+#endif // MYAUDIOPKT_H_INCLUDED
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myAwd.h"
+#include "myADC.h"
+#include "myIrq.h"
+#include "myRec.h"
+#include "myFormat.h"
+
+#define AWD_CR1_BITS    (ADC_CR1_AWDCH | ADC_CR1_AWDSGL | ADC_CR1_AWDEN | \
+                         ADC_CR1_JAWDEN | ADC_CR1_AWDIE)
+
+#if STM32_ADC_USE_ADC2 || STM32_ADC_USE_ADC3
+#error "awdAdcIrq only serves ADC1, the ADC interrupt is shared by all three"
+#endif
+
+static VirtualTimer awdTimer;
+
+/*
+ * Configuration, applied by awdArm
+ */
+static bool_t awdOn;
+static uint8_t awdChannel;
+static uint16_t awdLow, awdHigh;
+
+/*
+ * Queue filled by the interrupt, awdQueued follows the semaphore's count
+ */
+static AwdEvent awdQueue[AWD_EVENTS];
+static unsigned awdWr, awdRd, awdQueued;
+static Semaphore awdSem;
+static uint32_t awdCount;
+static uint32_t awdLost;
+
+/*
+ * The conversion that tripped the watchdog. VREFINT and the temperature
+ * sensor are the injected housekeeping group of the continuous
+ * conversion (JSQ3 and JSQ4, see myADC.c), everything else is regular.
+ */
+static uint16_t awdValue(void) {
+
+  if (awdChannel == ADC_CHANNEL_VREFINT)
+    return ADC1->JDR1;
+  if (awdChannel == ADC_CHANNEL_SENSOR)
+    return ADC1->JDR2;
+  return ADC1->DR;
+}
+
+static void awdRearm(void *arg) {
+
+  (void)arg;
+  chSysLockFromIsr();
+  if (awdOn) {
+    ADC1->SR = ~ADC_SR_AWD;
+    ADC1->CR1 |= ADC_CR1_AWDIE;
+  }
+  chSysUnlockFromIsr();
+}
+
+/*
+ * Replaces the ChibiOS ADC interrupt handler (see myIrq.h). It does the
+ * driver's part for ADC1, clearing SR and reporting overruns while the
+ * DMA still runs, and takes the watchdog events.
+ */
+static CH_IRQ_HANDLER(awdAdcIrq) {
+  tstamp_t now;
+  AwdEvent *ev;
+  uint32_t sr;
+  uint16_t value = 0;
+  bool_t limit;
+
+  /* before any call, the prologue takes EXC_RETURN from LR */
+  CH_IRQ_PROLOGUE();
+  now = tsNow();
+
+  sr = ADC1->SR;
+  limit = (sr & ADC_SR_AWD) && (ADC1->CR1 & ADC_CR1_AWDIE);
+  if (limit)
+    value = awdValue();
+  ADC1->SR = 0;
+
+  /* an overrun after the last conversion, before the driver stopped the
+     ADC, is none, hence the check of the DMA as in the driver */
+  if ((sr & ADC_SR_OVR) && dmaStreamGetTransactionSize(ADCD1.dmastp) > 0 &&
+      ADCD1.grpp != NULL)
+    _adc_isr_error_code(&ADCD1, ADC_ERR_OVERFLOW);
+
+  if (limit) {
+    chSysLockFromIsr();
+    ADC1->CR1 &= ~ADC_CR1_AWDIE;
+    awdCount++;
+    if (awdQueued < AWD_EVENTS) {
+      ev = &awdQueue[awdWr];
+      ev->time = now;
+      ev->value = value;
+      ev->channel = awdChannel;
+      ev->high = value > awdHigh;
+      awdWr = (awdWr + 1) % AWD_EVENTS;
+      awdQueued++;
+      chSemSignalI(&awdSem);
+    }
+    else
+      awdLost++;
+    chVTSetI(&awdTimer, AWD_HOLDOFF, awdRearm, NULL);
+    chSysUnlockFromIsr();
+    recLog(REC_EV_ADC_LIMIT, (uint32_t)awdChannel << 16 | value, value > awdHigh);
+  }
+
+  CH_IRQ_EPILOGUE();
+}
+
+/*
+ * Puts the configuration into the ADC, the continuous conversion calls
+ * this after every start
+ */
+void awdArm(void) {
+
+  chSysLock();
+  if (chVTIsArmedI(&awdTimer))
+    chVTResetI(&awdTimer);
+  if (awdOn) {
+    ADC1->LTR = awdLow;
+    ADC1->HTR = awdHigh;
+    ADC1->SR = ~ADC_SR_AWD;
+    ADC1->CR1 = (ADC1->CR1 & ~AWD_CR1_BITS) | awdChannel | ADC_CR1_AWDSGL |
+                ADC_CR1_AWDEN | ADC_CR1_JAWDEN | ADC_CR1_AWDIE;
+  }
+  else
+    ADC1->CR1 &= ~AWD_CR1_BITS;
+  chSysUnlock();
+}
+
+/*
+ * Watches one channel for conversions below low or above high (12 bit).
+ * Takes effect at once during a continuous conversion, else with the next.
+ */
+bool_t awdSet(unsigned channel, uint16_t low, uint16_t high) {
+
+  if (channel > ADC_CHANNEL_VBAT || low > high || high > 4095)
+    return FALSE;
+  chSysLock();
+  awdChannel = channel;
+  awdLow = low;
+  awdHigh = high;
+  awdOn = TRUE;
+  chSysUnlock();
+  if (myADCrunning())
+    awdArm();
+  return TRUE;
+}
+
+void awdOff(void) {
+
+  awdOn = FALSE;
+  awdArm();
+}
+
+/*
+ * Takes the oldest event, waits up to timeout for one
+ */
+bool_t awdFetch(AwdEvent *ev, systime_t timeout) {
+
+  if (chSemWaitTimeout(&awdSem, timeout) != RDY_OK)
+    return FALSE;
+  chSysLock();
+  *ev = awdQueue[awdRd];
+  awdRd = (awdRd + 1) % AWD_EVENTS;
+  awdQueued--;
+  chSysUnlock();
+  return TRUE;
+}
+
+/*
+ * sets up or switches off the watchdog, prints its state and the queued
+ * events
+ */
+void cmd_awd(BaseSequentialStream *chp, int argc, char *argv[]) {
+  char buf[FMT_U64_MAXLEN + 1];
+  unsigned long channel, low, high;
+  AwdEvent ev;
+
+  if ((argc != 0 && argc != 1 && argc != 3) ||
+      (argc == 1 && strcmp(argv[0], "off") != 0)) {
+    chprintf(chp, "Usage: awd [off | channel low high]\r\n");
+    return;
+  }
+  if (argc == 1)
+    awdOff();
+  if (argc == 3) {
+    /* range checked before narrowing to awdSet's types */
+    channel = strtoul(argv[0], NULL, 0);
+    low = strtoul(argv[1], NULL, 0);
+    high = strtoul(argv[2], NULL, 0);
+    if (channel > ADC_CHANNEL_VBAT || low > high || high > 4095 ||
+        !awdSet(channel, low, high)) {
+      chprintf(chp, "channel 0..%U, 0 <= low <= high <= 4095\r\n", ADC_CHANNEL_VBAT);
+      return;
+    }
+  }
+  if (awdOn)
+    chprintf(chp, "watchdog : channel %U, %U..%U, %s\r\n", awdChannel, awdLow,
+             awdHigh, myADCrunning() ? "armed" : "armed with mc");
+  else
+    chprintf(chp, "watchdog : off\r\n");
+  chprintf(chp, "events   : %U, %U lost\r\n", awdCount, awdLost);
+  while (awdFetch(&ev, TIME_IMMEDIATE)) {
+    buf[fmtU64(buf, tsToUs(ev.time))] = 0;
+    chprintf(chp, "%s us channel %U %s %U\r\n", buf, ev.channel,
+             ev.high ? "above" : "below", ev.value);
+  }
+}
+
+/*
+ * Takes over the ADC interrupt, needs irqInit first
+ */
+void awdInit(void) {
+
+  chSemInit(&awdSem, 0);
+  irqHook(ADC_IRQn, awdAdcIrq);
+}
@@ -0,0 +1,41 @@
+#ifndef MYAWD_H_INCLUDED
+#define MYAWD_H_INCLUDED
+
+/*
+ * Limit events from the analog watchdog of ADC1.
+ * The hardware compares every conversion of one channel against a low
+ * and a high threshold, only a conversion outside of them raises the ADC
+ * interrupt, which timestamps it into a queue. The interrupt is disabled
+ * for AWD_HOLDOFF after each event, so a lasting excursion gives one event
+ * per AWD_HOLDOFF instead of one per conversion. The module's handler
+ * replaces the driver's on the ADC vector and does the driver's work too.
+ *
+ * Starting a conversion rewrites CR1, the watchdog is armed again by the
+ * continuous conversion (awdArm), single scan conversions run without it.
+ */
+
+#include "myTime.h"
+
+/*
+ * Events waiting to be fetched, further ones are counted as lost
+ */
+#define AWD_EVENTS              32
+
+#define AWD_HOLDOFF             MS2ST(10)
+
+typedef struct {
+  tstamp_t time;
+  uint16_t value;                       /* the conversion out of limits     */
+  uint8_t channel;
+  uint8_t high;                         /* above the high threshold         */
+} AwdEvent;
+
+void awdInit(void);
+bool_t awdSet(unsigned channel, uint16_t low, uint16_t high);
+void awdOff(void);
+void awdArm(void);
+bool_t awdFetch(AwdEvent *ev, systime_t timeout);
+
+void cmd_awd(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYAWD_H_INCLUDED
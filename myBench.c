@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myBench.h"
+#include "myUSB.h"
+#include "myStream.h"
+#include "myData.h"
+#include "myADC.h"
+#include "myFormat.h"
+#include "myPool.h"
+#include "myTime.h"
+
+
+/*===========================================================================*/
+/* USB link benchmark, counterpart of host/usbbench.c                        */
+/*===========================================================================*/
+
+#define USBBENCH_BUF_SIZE       512
+
+/*
+ * Without traffic for this long a sink or echo run gives up
+ */
+#define USBBENCH_TIMEOUT        MS2ST(2000)
+
+static uint8_t benchBuf[USBBENCH_BUF_SIZE];
+
+/*
+ * Channel the raw data goes through, the console or the data channel
+ */
+static bool_t onData;
+
+static size_t benchWrite(const uint8_t *bp, size_t n, systime_t time) {
+
+#if MY_USE_DATA_CHANNEL
+  if (onData)
+    return dataWriteTimeout(&DCH1, bp, n, time);
+#endif
+  return chnWriteTimeout((BaseAsynchronousChannel *)&SDU1, bp, n, time);
+}
+
+static size_t benchRead(uint8_t *bp, size_t n, systime_t time) {
+
+#if MY_USE_DATA_CHANNEL
+  if (onData)
+    return dataReadTimeout(&DCH1, bp, n, time);
+#endif
+  return chnReadTimeout((BaseAsynchronousChannel *)&SDU1, bp, n, time);
+}
+
+/*
+ * Sends n bytes of a counting pattern in writes of chunk bytes
+ */
+static uint32_t benchGen(uint32_t n, uint32_t chunk) {
+  uint32_t done = 0, i, len;
+  uint8_t pattern = 0;
+
+  while (done < n) {
+    len = n - done < chunk ? n - done : chunk;
+    for (i = 0; i < len; i++)
+      benchBuf[i] = pattern++;
+    if (benchWrite(benchBuf, len, USBBENCH_TIMEOUT) != len)
+      break;
+    done += len;
+  }
+  return done;
+}
+
+/*
+ * Receives n bytes and counts the ones breaking the counting pattern
+ */
+static uint32_t benchSink(uint32_t n, uint32_t *errors) {
+  uint32_t done = 0, i, len;
+  uint8_t pattern = 0;
+
+  *errors = 0;
+  while (done < n) {
+    len = n - done < USBBENCH_BUF_SIZE ? n - done : USBBENCH_BUF_SIZE;
+    len = benchRead(benchBuf, len, USBBENCH_TIMEOUT);
+    if (len == 0)
+      break;
+    for (i = 0; i < len; i++)
+      if (benchBuf[i] != pattern++)
+        (*errors)++;
+    done += len;
+  }
+  return done;
+}
+
+/*
+ * Sends back whatever arrives as soon as it arrives, until n bytes passed
+ */
+static uint32_t benchEcho(uint32_t n) {
+  uint32_t done = 0, len;
+
+  while (done < n) {
+    len = benchRead(benchBuf, 1, USBBENCH_TIMEOUT);
+    if (len == 0)
+      break;
+    len += benchRead(benchBuf + 1, USBBENCH_BUF_SIZE - 1, TIME_IMMEDIATE);
+    benchWrite(benchBuf, len, TIME_INFINITE);
+    done += len;
+  }
+  return done;
+}
+
+/*
+ * usbbench gen|sink|echo bytes [chunk [data]]
+ * The output is framed by a "BENCH <mode> <bytes>" and a "BENCH END" line
+ * so the host tool can find the raw data between the shell output.
+ * With "data" the raw data goes through the data channel instead.
+ */
+void cmd_usbbench(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t n, chunk = 64, done, errors = 0;
+  systime_t start, elapsed;
+
+  if (argc < 2 || argc > 4 ||
+      (strcmp(argv[0], "gen") != 0 && strcmp(argv[0], "sink") != 0 &&
+       strcmp(argv[0], "echo") != 0) ||
+      (argc == 4 && (!MY_USE_DATA_CHANNEL || strcmp(argv[3], "data") != 0))) {
+#if MY_USE_DATA_CHANNEL
+    chprintf(chp, "Usage: usbbench gen|sink|echo bytes [chunk [data]]\r\n");
+#else
+    chprintf(chp, "Usage: usbbench gen|sink|echo bytes [chunk]\r\n");
+#endif
+    return;
+  }
+  n = strtoul(argv[1], NULL, 0);
+  if (argc >= 3)
+    chunk = strtoul(argv[2], NULL, 0);
+  onData = argc == 4;
+  if (chunk == 0 || chunk > USBBENCH_BUF_SIZE)
+    chunk = USBBENCH_BUF_SIZE;
+
+#if MY_USE_DATA_CHANNEL
+  /* takes the channel away from the RPC server before the host
+     starts sending */
+  if (onData)
+    chMtxLock(&DCH1.lock);
+#endif
+  chprintf(chp, "BENCH %s %U\r\n", argv[0], n);
+  /* the raw data bypasses the shell stream, which has to be empty first */
+  if (chp == (BaseSequentialStream *)&BSD1)
+    bsFlush(&BSD1);
+  start = chTimeNow();
+  if (strcmp(argv[0], "gen") == 0)
+    done = benchGen(n, chunk);
+  else if (strcmp(argv[0], "sink") == 0)
+    done = benchSink(n, &errors);
+  else
+    done = benchEcho(n);
+  elapsed = chTimeNow() - start;
+#if MY_USE_DATA_CHANNEL
+  if (onData)
+    chMtxUnlock();
+#endif
+  chprintf(chp, "\r\nBENCH END %U bytes %U ms %U errors\r\n",
+           done, elapsed * 1000 / CH_FREQUENCY, errors);
+}
+
+
+/*===========================================================================*/
+/* On target microbenchmarks                                                 */
+/*===========================================================================*/
+
+/*
+ * Every test runs this many rounds, min/median/max are taken over them
+ */
+#define MICRO_ROUNDS            9
+
+typedef struct {
+  const char *name;
+  uint32_t ops;                         /* per round                        */
+  void (*run)(uint32_t ops);
+} MicroTest;
+
+static Thread *microPeer;
+static Semaphore microSem;
+static Mailbox microMB;
+static msg_t microMBBuf[4];
+static adcsample_t *microBlock;
+
+/*
+ * Answers every message right away, each round trip is two switches
+ */
+static WORKING_AREA(waMicroPeer, 128);
+static msg_t microPeerThread(void *arg) {
+  Thread *tp;
+
+  (void)arg;
+  chRegSetThreadName("benchpeer");
+  while (!chThdShouldTerminate()) {
+    tp = chMsgWait();
+    chMsgRelease(tp, RDY_OK);
+  }
+  return 0;
+}
+
+static void microSwitch(uint32_t ops) {
+
+  for (ops /= 2; ops > 0; ops--)
+    chMsgSend(microPeer, 0);
+}
+
+static void microSemaphore(uint32_t ops) {
+
+  while (ops--) {
+    chSemSignal(&microSem);
+    chSemWait(&microSem);
+  }
+}
+
+static void microMailbox(uint32_t ops) {
+  msg_t msg;
+
+  while (ops--) {
+    chMBPost(&microMB, ops, TIME_IMMEDIATE);
+    chMBFetch(&microMB, &msg, TIME_IMMEDIATE);
+  }
+}
+
+/*
+ * ops is the number of sequences, one pool block worth
+ */
+static void microReduce(uint32_t ops) {
+
+  (void)myADCreduce(microBlock, ops);
+}
+
+/*
+ * one line of measureRead
+ */
+static void microChprintf(uint32_t ops) {
+
+  while (ops--)
+    chprintf(&fmtNullStream, "%U:%U-%U-%U  ", ops, 65535, 3200, 1500);
+}
+
+/*
+ * ops is in kB, copied from one half of the block to the other
+ */
+static void microMemcpy(uint32_t ops) {
+
+  while (ops--)
+    memcpy(microBlock, microBlock + POOL_BLOCK_SAMPLES / 2, POOL_BLOCK_SIZE / 2);
+}
+
+static const MicroTest microTests[] = {
+  {"cswitch", 200, microSwitch},
+  {"semaphore", 1000, microSemaphore},
+  {"mailbox", 1000, microMailbox},
+  {"adcreduce", POOL_BLOCK_SAMPLES / ADC_CONT_NUM_CHANNELS, microReduce},
+  {"chprintf", 100, microChprintf},
+  {"memcpy1k", 16, microMemcpy},
+};
+#define MICRO_TESTS     (sizeof(microTests) / sizeof(microTests[0]))
+
+static void microRun(BaseSequentialStream *chp, const MicroTest *mt) {
+  uint32_t perOp[MICRO_ROUNDS], v;
+  unsigned i, j;
+
+  for (i = 0; i < MICRO_ROUNDS; i++) {
+    TS_START(start);
+    mt->run(mt->ops);
+    v = TS_ELAPSED(start) / mt->ops;
+    /* insertion sort for the median */
+    for (j = i; j > 0 && perOp[j - 1] > v; j--)
+      perOp[j] = perOp[j - 1];
+    perOp[j] = v;
+  }
+  chprintf(chp, "%s %U %U %U %U\r\n", mt->name, mt->ops, perOp[0],
+           perOp[MICRO_ROUNDS / 2], perOp[MICRO_ROUNDS - 1]);
+}
+
+/*
+ * Runs the fixed suite, or only the named test, and prints one line per
+ * test: name, ops per round, min, median and max CPU cycles per op.
+ * Lines starting with # describe the build, so two outputs can be diffed.
+ */
+void cmd_bench(BaseSequentialStream *chp, int argc, char *argv[]) {
+  unsigned i;
+
+  if (argc > 1) {
+    chprintf(chp, "Usage: bench [test]\r\n");
+    return;
+  }
+  microBlock = poolAlloc();
+  if (!microBlock) {
+    chprintf(chp, "No free sample block\r\n");
+    return;
+  }
+  for (i = 0; i < POOL_BLOCK_SAMPLES; i++)
+    microBlock[i] = (i * 2654435761u) >> 20;
+  chSemInit(&microSem, 0);
+  chMBInit(&microMB, microMBBuf, sizeof(microMBBuf) / sizeof(microMBBuf[0]));
+  microPeer = chThdCreateStatic(waMicroPeer, sizeof(waMicroPeer),
+                                chThdGetPriority() + 1, microPeerThread, NULL);
+
+  chprintf(chp, "# bench 1\r\n");
+  chprintf(chp, "# hclk %U\r\n", STM32_HCLK);
+  chprintf(chp, "# CH_OPTIMIZE_SPEED %d\r\n", CH_OPTIMIZE_SPEED);
+  chprintf(chp, "# CH_DBG_SYSTEM_STATE_CHECK %d\r\n", CH_DBG_SYSTEM_STATE_CHECK);
+  chprintf(chp, "# CH_DBG_ENABLE_CHECKS %d\r\n", CH_DBG_ENABLE_CHECKS);
+  chprintf(chp, "# CH_DBG_ENABLE_ASSERTS %d\r\n", CH_DBG_ENABLE_ASSERTS);
+  chprintf(chp, "# CH_DBG_ENABLE_TRACE %d\r\n", CH_DBG_ENABLE_TRACE);
+  chprintf(chp, "# CH_DBG_ENABLE_STACK_CHECK %d\r\n", CH_DBG_ENABLE_STACK_CHECK);
+  chprintf(chp, "# CH_DBG_FILL_THREADS %d\r\n", CH_DBG_FILL_THREADS);
+  chprintf(chp, "# CH_DBG_THREADS_PROFILING %d\r\n", CH_DBG_THREADS_PROFILING);
+  chprintf(chp, "# STM32_ADC_ADCPRE 0x%x\r\n", STM32_ADC_ADCPRE);
+  chprintf(chp, "# test ops min median max (cycles per op)\r\n");
+  for (i = 0; i < MICRO_TESTS; i++)
+    if (argc == 0 || strcmp(argv[0], microTests[i].name) == 0)
+      microRun(chp, &microTests[i]);
+
+  chThdTerminate(microPeer);
+  chMsgSend(microPeer, 0);
+  chThdWait(microPeer);
+  poolFree(microBlock);
+}
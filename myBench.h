@@ -0,0 +1,7 @@
+#ifndef MYBENCH_H_INCLUDED
+#define MYBENCH_H_INCLUDED
+
+void cmd_usbbench(BaseSequentialStream *chp, int argc, char *argv[]);
+void cmd_bench(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYBENCH_H_INCLUDED
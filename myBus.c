@@ -0,0 +1,186 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myBus.h"
+
+
+static BusMsg busMsgs[BUS_MSGS];
+static MemoryPool busPool;
+
+/*
+ * Subscribers, only ever added to
+ */
+static BusSub *busSubs;
+
+static uint32_t busSeq;
+static uint32_t busDropped;
+
+static void busFreeI(BusMsg *m) {
+  unsigned i;
+
+  for (i = 0; i < BUS_BLOCKS; i++) {
+    if (m->blocks[i])
+      poolFreeI(m->blocks[i]);
+    m->blocks[i] = NULL;
+  }
+  chPoolFreeI(&busPool, m);
+}
+
+/*
+ * Message with enough pool blocks for samples, NULL if either is short
+ */
+static BusMsg *busAllocI(size_t samples) {
+  BusMsg *m;
+  unsigned i;
+
+  m = chPoolAllocI(&busPool);
+  if (!m)
+    return NULL;
+  for (i = 0; i < BUS_BLOCKS; i++)
+    m->blocks[i] = NULL;
+  for (i = 0; i * POOL_BLOCK_SAMPLES < samples; i++) {
+    m->blocks[i] = poolAllocI();
+    if (!m->blocks[i]) {
+      busFreeI(m);
+      return NULL;
+    }
+  }
+  return m;
+}
+
+/*
+ * Called by the ADC callback for each half buffer. Nothing is copied if
+ * no subscriber is enabled.
+ */
+void busPublish(const adcsample_t *buffer, size_t sequences,
+                const AdcHousekeeping *hk, const AdcHalf *result) {
+  size_t samples = sequences * ADC_CONT_NUM_CHANNELS, i, len;
+  bool_t wanted = FALSE;
+  BusSub *sub;
+  BusMsg *m = NULL;
+
+  chSysLockFromIsr();
+  for (sub = busSubs; sub != NULL; sub = sub->next)
+    wanted |= sub->enabled;
+  if (wanted && sequences <= BUS_MAX_SEQUENCES)
+    m = busAllocI(samples);
+  if (!m) {
+    if (wanted) {
+      busDropped++;
+      for (sub = busSubs; sub != NULL; sub = sub->next)
+        if (sub->enabled)
+          sub->overruns++;
+    }
+    busSeq++;
+    chSysUnlockFromIsr();
+    return;
+  }
+  m->refs = 0;
+  m->seq = busSeq++;
+  m->time = tsNow();
+  m->sequences = sequences;
+  m->result = *result;
+  m->hk = *hk;
+  chSysUnlockFromIsr();
+
+  /* the blocks belong to this message now, no need to lock while copying */
+  for (i = 0; i * POOL_BLOCK_SAMPLES < samples; i++) {
+    len = samples - i * POOL_BLOCK_SAMPLES;
+    if (len > POOL_BLOCK_SAMPLES)
+      len = POOL_BLOCK_SAMPLES;
+    memcpy(m->blocks[i], buffer + i * POOL_BLOCK_SAMPLES, len * sizeof(adcsample_t));
+  }
+
+  /* no subscriber runs before all references are handed out */
+  chSysLockFromIsr();
+  for (sub = busSubs; sub != NULL; sub = sub->next) {
+    if (!sub->enabled)
+      continue;
+    if (chMBPostI(&sub->mb, (msg_t)m) == RDY_OK)
+      m->refs++;
+    else
+      sub->overruns++;
+  }
+  if (m->refs == 0)
+    busFreeI(m);
+  chSysUnlockFromIsr();
+}
+
+/*
+ * Next message of a subscriber, NULL on timeout. Hand it back with
+ * busRelease.
+ */
+BusMsg *busFetch(BusSub *sub, systime_t timeout) {
+  msg_t msg;
+
+  if (chMBFetch(&sub->mb, &msg, timeout) != RDY_OK)
+    return NULL;
+  sub->received++;
+  return (BusMsg *)msg;
+}
+
+void busRelease(BusMsg *m) {
+
+  chSysLock();
+  if (--m->refs == 0)
+    busFreeI(m);
+  chSysUnlock();
+}
+
+/*
+ * Adds a subscriber, disabled. Messages still queued when it gets
+ * disabled again have to be fetched and released as usual.
+ */
+void busSubscribe(BusSub *sub, const char *name) {
+
+  sub->name = name;
+  sub->enabled = FALSE;
+  sub->received = 0;
+  sub->overruns = 0;
+  chMBInit(&sub->mb, sub->mbBuf, BUS_QUEUE);
+  chSysLock();
+  sub->next = busSubs;
+  busSubs = sub;
+  chSysUnlock();
+}
+
+void busEnable(BusSub *sub, bool_t enabled) {
+
+  sub->enabled = enabled;
+}
+
+/*
+ * prints the subscribers and their counters
+ */
+void cmd_bus(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t received, overruns, queued;
+  bool_t enabled;
+  BusSub *sub;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: bus\r\n");
+    return;
+  }
+  chprintf(chp, "published : %U, %U without a free message\r\n", busSeq, busDropped);
+  chprintf(chp, "subscriber        on   received   overruns  queued\r\n");
+  for (sub = busSubs; sub != NULL; sub = sub->next) {
+    chSysLock();
+    enabled = sub->enabled;
+    received = sub->received;
+    overruns = sub->overruns;
+    queued = chMBGetUsedCountI(&sub->mb);
+    chSysUnlock();
+    chprintf(chp, "%-16s %3s %10U %10U %7U\r\n", sub->name, enabled ? "yes" : "no",
+             received, overruns, queued);
+  }
+}
+
+void busInit(void) {
+
+  chPoolInit(&busPool, sizeof(BusMsg), NULL);
+  chPoolLoadArray(&busPool, busMsgs, BUS_MSGS);
+}
@@ -0,0 +1,65 @@
+#ifndef MYBUS_H_INCLUDED
+#define MYBUS_H_INCLUDED
+
+/*
+ * Publish/subscribe bus for the half buffers of the continuous conversion.
+ * adccallback publishes every half buffer once: its samples are copied
+ * into pool blocks, together with the results of adcPipeHalf, and every
+ * enabled subscriber gets a reference in its own mailbox. Subscribers
+ * read at their own pace and release the message when done, the last
+ * release gives the blocks back to the pool. A subscriber whose mailbox
+ * is full misses that half buffer and counts an overrun, the others do
+ * not notice.
+ */
+
+#include "myPool.h"
+#include "myTime.h"
+#include "myADCPipe.h"
+
+/*
+ * Messages in flight, each holds one half buffer in BUS_BLOCKS pool blocks
+ */
+#define BUS_MSGS                4
+#define BUS_BLOCKS              4
+#define BUS_MAX_SEQUENCES       (BUS_BLOCKS * POOL_BLOCK_SAMPLES / ADC_CONT_NUM_CHANNELS)
+
+/*
+ * Messages a subscriber can have waiting
+ */
+#define BUS_QUEUE               3
+
+typedef struct {
+  uint32_t refs;                        /* subscribers still holding it     */
+  uint32_t seq;                         /* half buffers published before    */
+  tstamp_t time;                        /* when the half buffer was full    */
+  size_t sequences;
+  AdcHalf result;
+  AdcHousekeeping hk;
+  adcsample_t *blocks[BUS_BLOCKS];
+} BusMsg;
+
+#define BUS_SAMPLE(m, i) \
+  ((m)->blocks[(i) / POOL_BLOCK_SAMPLES][(i) % POOL_BLOCK_SAMPLES])
+
+typedef struct BusSub {
+  const char *name;
+  struct BusSub *next;
+  bool_t enabled;                       /* gets messages                    */
+  Mailbox mb;
+  msg_t mbBuf[BUS_QUEUE];
+  uint32_t received;
+  uint32_t overruns;                    /* messages missed, queue full or   */
+                                        /* no message or blocks left        */
+} BusSub;
+
+void busInit(void);
+void busSubscribe(BusSub *sub, const char *name);
+void busEnable(BusSub *sub, bool_t enabled);
+void busPublish(const adcsample_t *buffer, size_t sequences,
+                const AdcHousekeeping *hk, const AdcHalf *result);
+BusMsg *busFetch(BusSub *sub, systime_t timeout);
+void busRelease(BusMsg *m);
+
+void cmd_bus(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYBUS_H_INCLUDED
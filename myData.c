@@ -0,0 +1,216 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myData.h"
+#include "myTime.h"
+#include "myLoad.h"
+
+#if MY_USE_DATA_CHANNEL
+
+/*
+ * The data channel, works like SDU1 but with its own endpoint and queues
+ */
+DataChannel DCH1;
+
+/*
+ * Output queue notification, starts a transfer unless one is running.
+ * Same scheme as the serial over USB driver.
+ */
+static void onotify(GenericQueue *qp) {
+  size_t n;
+
+  (void)qp;
+  if (usbGetDriverStateI(DCH1.usbp) != USB_ACTIVE)
+    return;
+  if (!usbGetTransmitStatusI(DCH1.usbp, DATA_EP)) {
+    if ((n = chOQGetFullI(&DCH1.oqueue)) > 0) {
+      chSysUnlock();
+      usbPrepareQueuedTransmit(DCH1.usbp, DATA_EP, &DCH1.oqueue, n);
+      chSysLock();
+      usbStartTransmitI(DCH1.usbp, DATA_EP);
+      DCH1.sent += n;
+      DCH1.transfers++;
+    }
+  }
+}
+
+/*
+ * Input queue notification, restarts reception once a packet fits again
+ */
+static void inotify(GenericQueue *qp) {
+  size_t n;
+
+  (void)qp;
+  if (usbGetDriverStateI(DCH1.usbp) != USB_ACTIVE)
+    return;
+  if (!usbGetReceiveStatusI(DCH1.usbp, DATA_EP)) {
+    if ((n = chIQGetEmptyI(&DCH1.iqueue)) >= 0x0040) {
+      n = n / 0x0040 * 0x0040;
+      chSysUnlock();
+      usbPrepareQueuedReceive(DCH1.usbp, DATA_EP, &DCH1.iqueue, n);
+      chSysLock();
+      usbStartReceiveI(DCH1.usbp, DATA_EP);
+    }
+  }
+}
+
+/*
+ * IN transfer done, continues with whatever has been queued meanwhile
+ */
+static void dataTransmitted(USBDriver *usbp, usbep_t ep) {
+  TS_START(start);
+  size_t n;
+
+  chSysLockFromIsr();
+  if ((n = chOQGetFullI(&DCH1.oqueue)) > 0) {
+    chSysUnlockFromIsr();
+    usbPrepareQueuedTransmit(usbp, ep, &DCH1.oqueue, n);
+    chSysLockFromIsr();
+    usbStartTransmitI(usbp, ep);
+    DCH1.sent += n;
+    DCH1.transfers++;
+  }
+  else if ((usbp->epc[ep]->in_state->txsize > 0) &&
+           !(usbp->epc[ep]->in_state->txsize & (0x0040 - 1))) {
+    /* A transfer ending on a packet boundary needs a zero length packet.*/
+    chSysUnlockFromIsr();
+    usbPrepareTransmit(usbp, ep, NULL, 0);
+    chSysLockFromIsr();
+    usbStartTransmitI(usbp, ep);
+  }
+  chSysUnlockFromIsr();
+  loadIrq(LOAD_IRQ_USB, TS_ELAPSED(start));
+}
+
+/*
+ * OUT transfer done, the data is in the input queue already
+ */
+static void dataReceived(USBDriver *usbp, usbep_t ep) {
+  TS_START(start);
+  size_t n;
+
+  chSysLockFromIsr();
+  DCH1.received += usbGetReceiveTransactionSizeI(usbp, ep);
+  if ((n = chIQGetEmptyI(&DCH1.iqueue)) >= 0x0040) {
+    n = n / 0x0040 * 0x0040;
+    chSysUnlockFromIsr();
+    usbPrepareQueuedReceive(usbp, ep, &DCH1.iqueue, n);
+    chSysLockFromIsr();
+    usbStartReceiveI(usbp, ep);
+  }
+  chSysUnlockFromIsr();
+  loadIrq(LOAD_IRQ_USB, TS_ELAPSED(start));
+}
+
+/**
+ * @brief   IN EP3 state.
+ */
+static USBInEndpointState ep3instate;
+
+/**
+ * @brief   OUT EP3 state.
+ */
+static USBOutEndpointState ep3outstate;
+
+/**
+ * @brief   EP3 initialization structure (both IN and OUT).
+ */
+static const USBEndpointConfig ep3config = {
+  USB_EP_MODE_TYPE_BULK,
+  NULL,
+  dataTransmitted,
+  dataReceived,
+  0x0040,
+  0x0040,
+  &ep3instate,
+  &ep3outstate,
+  NULL
+};
+
+/*
+ * Drops everything queued, readers and writers get Q_RESET
+ */
+void dataResetI(DataChannel *dcp) {
+
+  chIQResetI(&dcp->iqueue);
+  chOQResetI(&dcp->oqueue);
+}
+
+/*
+ * Called from the CONFIGURED event with the system locked
+ */
+void dataConfigureHookI(USBDriver *usbp) {
+
+  usbInitEndpointI(usbp, DATA_EP, &ep3config);
+  dataResetI(&DCH1);
+  usbPrepareQueuedReceive(usbp, DATA_EP, &DCH1.iqueue, 0x0040);
+  usbStartReceiveI(usbp, DATA_EP);
+}
+
+size_t dataWriteTimeout(DataChannel *dcp, const uint8_t *bp, size_t n, systime_t time) {
+
+  return chOQWriteTimeout(&dcp->oqueue, bp, n, time);
+}
+
+size_t dataReadTimeout(DataChannel *dcp, uint8_t *bp, size_t n, systime_t time) {
+
+  return chIQReadTimeout(&dcp->iqueue, bp, n, time);
+}
+
+static size_t write(void *ip, const uint8_t *bp, size_t n) {
+
+  return chOQWriteTimeout(&((DataChannel *)ip)->oqueue, bp, n, TIME_INFINITE);
+}
+
+static size_t read(void *ip, uint8_t *bp, size_t n) {
+
+  return chIQReadTimeout(&((DataChannel *)ip)->iqueue, bp, n, TIME_INFINITE);
+}
+
+static msg_t put(void *ip, uint8_t b) {
+
+  return chOQPutTimeout(&((DataChannel *)ip)->oqueue, b, TIME_INFINITE);
+}
+
+static msg_t get(void *ip) {
+
+  return chIQGetTimeout(&((DataChannel *)ip)->iqueue, TIME_INFINITE);
+}
+
+static const struct BaseSequentialStreamVMT vmt = {write, read, put, get};
+
+void dataObjectInit(DataChannel *dcp, USBDriver *usbp) {
+
+  dcp->vmt = &vmt;
+  dcp->usbp = usbp;
+  chMtxInit(&dcp->lock);
+  chIQInit(&dcp->iqueue, dcp->ib, DATA_IN_BUFFER_SIZE, inotify, dcp);
+  chOQInit(&dcp->oqueue, dcp->ob, DATA_OUT_BUFFER_SIZE, onotify, dcp);
+  dcp->sent = 0;
+  dcp->received = 0;
+  dcp->transfers = 0;
+}
+
+/*
+ * prints the state of the data channel
+ */
+void cmd_data(BaseSequentialStream *chp, int argc, char *argv[]) {
+  size_t out, in;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: data\r\n");
+    return;
+  }
+  chSysLock();
+  out = chOQGetFullI(&DCH1.oqueue);
+  in = chIQGetFullI(&DCH1.iqueue);
+  chSysUnlock();
+  chprintf(chp, "sent       : %U bytes in %U transfers\r\n", DCH1.sent, DCH1.transfers);
+  chprintf(chp, "received   : %U bytes\r\n", DCH1.received);
+  chprintf(chp, "queued out : %U/%U\r\n", out, DATA_OUT_BUFFER_SIZE);
+  chprintf(chp, "queued in  : %U/%U\r\n", in, DATA_IN_BUFFER_SIZE);
+}
+
+#endif /* MY_USE_DATA_CHANNEL */
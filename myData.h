@@ -0,0 +1,54 @@
+#ifndef MYDATA_H_INCLUDED
+#define MYDATA_H_INCLUDED
+
+/*
+ * Second USB function carrying binary data, so streams and the console
+ * never share a queue. Enabled by default, see USE_DATA_CHANNEL.
+ */
+#if !defined(MY_USE_DATA_CHANNEL)
+#define MY_USE_DATA_CHANNEL             FALSE
+#endif
+
+#if MY_USE_DATA_CHANNEL
+
+/*
+ * Bulk IN and OUT endpoint of the data interface
+ * (the console's CDC OUT endpoint moves from EP3 to EP1)
+ */
+#define DATA_EP                         3
+#define DATA_INTERFACE                  2
+
+/*
+ * Queue sizes, independent from the console's SERIAL_USB_BUFFERS_SIZE
+ */
+#define DATA_OUT_BUFFER_SIZE            1024
+#define DATA_IN_BUFFER_SIZE             256
+
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  InputQueue iqueue;
+  OutputQueue oqueue;
+  uint8_t ib[DATA_IN_BUFFER_SIZE];
+  uint8_t ob[DATA_OUT_BUFFER_SIZE];
+  USBDriver *usbp;
+  Mutex lock;                           /* held by whoever uses the channel,
+                                           the RPC server or usbbench       */
+  /* statistics */
+  uint32_t sent;
+  uint32_t received;
+  uint32_t transfers;
+} DataChannel;
+
+extern DataChannel DCH1;
+
+void dataObjectInit(DataChannel *dcp, USBDriver *usbp);
+void dataConfigureHookI(USBDriver *usbp);
+void dataResetI(DataChannel *dcp);
+size_t dataWriteTimeout(DataChannel *dcp, const uint8_t *bp, size_t n, systime_t time);
+size_t dataReadTimeout(DataChannel *dcp, uint8_t *bp, size_t n, systime_t time);
+
+void cmd_data(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif /* MY_USE_DATA_CHANNEL */
+
+#endif // MYDATA_H_INCLUDED
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myDecim.h"
+#include "myBus.h"
+#include "myStack.h"
+
+typedef struct {
+  uint32_t ratio;                       /* inputs per output                */
+  uint32_t count;                       /* inputs in acc so far             */
+  uint64_t acc;
+  uint32_t outputs;
+  uint32_t ring[DECIM_RING];            /* latest outputs, at outputs - 1   */
+  DecimSub *subs;
+} DecimStage;
+
+static DecimStage decimStages[DECIM_STAGES];
+static const uint32_t decimDefaults[DECIM_STAGES] = DECIM_RATIOS;
+
+/*
+ * Held by the thread while it runs the cascade on a half buffer
+ */
+static MUTEX_DECL(decimMutex);
+
+static BusSub decimBusSub;
+static bool_t decimOn;
+static bool_t decimSynced;              /* decimNextSeq is known            */
+static uint32_t decimNextSeq;
+static uint32_t decimGaps;              /* half buffers the bus missed      */
+
+/*
+ * Puts out a value of stage k: into its ring and to its subscribers
+ */
+static void decimOut(unsigned k, uint32_t value) {
+  DecimStage *st = &decimStages[k];
+  DecimSub *sub;
+
+  st->ring[st->outputs % DECIM_RING] = value;
+  st->outputs++;
+  if (st->subs == NULL)
+    return;
+  chSysLock();
+  for (sub = st->subs; sub != NULL; sub = sub->next)
+    if (sub->enabled && chMBPostI(&sub->mb, (msg_t)value) != RDY_OK)
+      sub->overruns++;
+  chSysUnlock();
+}
+
+/*
+ * Feeds one value into stage k, the output goes on to stage k+1
+ */
+static void decimPush(unsigned k, uint32_t value) {
+  DecimStage *st;
+
+  for (; k < DECIM_STAGES; k++) {
+    st = &decimStages[k];
+    st->acc += value;
+    if (++st->count < st->ratio)
+      return;
+    value = (st->acc + st->ratio / 2) / st->ratio;
+    st->acc = 0;
+    st->count = 0;
+    decimOut(k, value);
+  }
+}
+
+/*
+ * Sums up each sequence of the half buffer, on the scale of data[]
+ * (8 samples of 12 bit times 2) with DECIM_FRAC_BITS more, and runs it
+ * through the cascade. Sequences do not straddle pool blocks.
+ */
+static void decimHalf(const BusMsg *m) {
+  size_t samples = m->sequences * ADC_CONT_NUM_CHANNELS, i, j, len;
+  const adcsample_t *p;
+  uint32_t seqSum;
+
+  for (i = 0; i * POOL_BLOCK_SAMPLES < samples; i++) {
+    len = samples - i * POOL_BLOCK_SAMPLES;
+    if (len > POOL_BLOCK_SAMPLES)
+      len = POOL_BLOCK_SAMPLES;
+    p = m->blocks[i];
+    for (j = 0; j < len; j += ADC_CONT_NUM_CHANNELS) {
+      seqSum = p[j] + p[j+1] + p[j+2] + p[j+3] + p[j+4] + p[j+5] + p[j+6] + p[j+7];
+      decimPush(0, seqSum << (1 + DECIM_FRAC_BITS));
+    }
+  }
+}
+
+static WORKING_AREA(waDecim, 256);
+static msg_t decimThread(void *arg) {
+  BusMsg *m;
+
+  (void)arg;
+  chRegSetThreadName("decim");
+  while (TRUE) {
+    m = busFetch(&decimBusSub, TIME_INFINITE);
+    if (decimOn) {
+      chMtxLock(&decimMutex);
+      if (decimSynced && m->seq != decimNextSeq)
+        decimGaps++;
+      decimSynced = TRUE;
+      decimNextSeq = m->seq + 1;
+      decimHalf(m);
+      chMtxUnlock();
+    }
+    busRelease(m);
+  }
+  return 0;
+}
+
+/*
+ * Adds a subscriber to the outputs of a stage (0 is the fastest),
+ * disabled. Values still queued when it gets disabled again stay there
+ * until fetched.
+ */
+bool_t decimSubscribe(DecimSub *sub, unsigned stage, const char *name) {
+
+  if (stage >= DECIM_STAGES)
+    return FALSE;
+  sub->name = name;
+  sub->stage = stage;
+  sub->enabled = FALSE;
+  sub->received = 0;
+  sub->overruns = 0;
+  chMBInit(&sub->mb, sub->mbBuf, DECIM_QUEUE);
+  chSysLock();
+  sub->next = decimStages[stage].subs;
+  decimStages[stage].subs = sub;
+  chSysUnlock();
+  return TRUE;
+}
+
+void decimEnable(DecimSub *sub, bool_t enabled) {
+
+  sub->enabled = enabled;
+}
+
+/*
+ * Next value of a subscriber's stage, FALSE on timeout
+ */
+bool_t decimFetch(DecimSub *sub, uint32_t *value, systime_t timeout) {
+  msg_t msg;
+
+  if (chMBFetch(&sub->mb, &msg, timeout) != RDY_OK)
+    return FALSE;
+  sub->received++;
+  *value = (uint32_t)msg;
+  return TRUE;
+}
+
+/*
+ * New ratios for all stages, 1..DECIM_MAX_RATIO each. The cascade starts
+ * over, the rings are kept.
+ */
+bool_t decimSetRatios(const uint32_t *ratios) {
+  unsigned k;
+
+  for (k = 0; k < DECIM_STAGES; k++)
+    if (ratios[k] == 0 || ratios[k] > DECIM_MAX_RATIO)
+      return FALSE;
+  chMtxLock(&decimMutex);
+  for (k = 0; k < DECIM_STAGES; k++) {
+    decimStages[k].ratio = ratios[k];
+    decimStages[k].count = 0;
+    decimStages[k].acc = 0;
+  }
+  chMtxUnlock();
+  return TRUE;
+}
+
+static void decimPrintValue(BaseSequentialStream *chp, uint32_t v) {
+
+  chprintf(chp, "%U.%02U", v >> DECIM_FRAC_BITS,
+           ((v & ((1 << DECIM_FRAC_BITS) - 1)) * 100) >> DECIM_FRAC_BITS);
+}
+
+/*
+ * prints the latest values of one stage, oldest first
+ */
+static void decimPrintRing(BaseSequentialStream *chp, unsigned k) {
+  static uint32_t ring[DECIM_RING];
+  uint32_t outputs, n, i;
+
+  chMtxLock(&decimMutex);
+  outputs = decimStages[k].outputs;
+  memcpy(ring, decimStages[k].ring, sizeof(ring));
+  chMtxUnlock();
+  n = outputs < DECIM_RING ? outputs : DECIM_RING;
+  for (i = outputs - n; i != outputs; i++) {
+    decimPrintValue(chp, ring[i % DECIM_RING]);
+    chprintf(chp, (i + 1) % 8 == 0 ? "\r\n" : "  ");
+  }
+  chprintf(chp, "\r\n");
+}
+
+/*
+ * switches the cascade on or off, sets the ratios, prints the outputs
+ * and their subscribers or the ring of one stage
+ */
+void cmd_decim(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t ratios[DECIM_STAGES], rate;
+  uint64_t div = 1;
+  DecimStage *st;
+  DecimSub *sub;
+  unsigned k;
+
+  if (argc == 1 && strcmp(argv[0], "on") == 0) {
+    chMtxLock(&decimMutex);
+    decimSynced = FALSE;
+    decimOn = TRUE;
+    chMtxUnlock();
+    busEnable(&decimBusSub, TRUE);
+  }
+  else if (argc == 1 && strcmp(argv[0], "off") == 0) {
+    busEnable(&decimBusSub, FALSE);
+    decimOn = FALSE;
+  }
+  else if (argc == 1 && atoi(argv[0]) >= 1 && atoi(argv[0]) <= DECIM_STAGES) {
+    decimPrintRing(chp, atoi(argv[0]) - 1);
+    return;
+  }
+  else if (argc == DECIM_STAGES) {
+    for (k = 0; k < DECIM_STAGES; k++)
+      ratios[k] = strtoul(argv[k], NULL, 0);
+    if (!decimSetRatios(ratios)) {
+      chprintf(chp, "ratios 1..%U\r\n", DECIM_MAX_RATIO);
+      return;
+    }
+  }
+  else if (argc != 0) {
+    chprintf(chp, "Usage: decim [on | off | stage | r1 r2 r3]\r\n");
+    return;
+  }
+
+  chprintf(chp, "cascade : %s, %U half buffers missed\r\n",
+           decimOn ? "on" : "off", decimGaps);
+  for (k = 0; k < DECIM_STAGES; k++) {
+    st = &decimStages[k];
+    div *= st->ratio;
+    rate = ADC_CONT_SEQ_RATE * 1000ULL / div;
+    chprintf(chp, "stage %U : /%U, %U.%03U Hz, %U outputs, latest ", k + 1,
+             st->ratio, rate / 1000, rate % 1000, st->outputs);
+    decimPrintValue(chp, st->outputs ? st->ring[(st->outputs - 1) % DECIM_RING] : 0);
+    chprintf(chp, "\r\n");
+    for (sub = st->subs; sub != NULL; sub = sub->next)
+      chprintf(chp, "  %-16s %3s %10U received %10U overruns\r\n", sub->name,
+               sub->enabled ? "yes" : "no", sub->received, sub->overruns);
+  }
+}
+
+/*
+ * Needs busInit first
+ */
+void decimInit(void) {
+
+  decimSetRatios(decimDefaults);
+  busSubscribe(&decimBusSub, "decim");
+  stackWatch("decim", waDecim, sizeof(waDecim));
+  chThdCreateStatic(waDecim, sizeof(waDecim), NORMALPRIO, decimThread, NULL);
+}
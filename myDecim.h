@@ -0,0 +1,56 @@
+#ifndef MYDECIM_H_INCLUDED
+#define MYDECIM_H_INCLUDED
+
+/*
+ * Multi-rate outputs of the continuous conversion.
+ * A thread subscribed to the half buffer bus (myBus.h) runs a cascade of
+ * averaging decimators: the first stage takes every sequence of PC1, each
+ * further stage only the outputs of the one before, so the slow outputs
+ * cost next to nothing. Every stage is an output with a ring of its latest
+ * values and subscribers of its own, each with a queue and overrun count
+ * like on the bus.
+ */
+
+#include "myADC.h"
+
+#define DECIM_STAGES            3
+
+/*
+ * Default ratios, each to the stage before: 5335 Hz sequences give about
+ * 667 Hz for control, 111 Hz for trending and 1 Hz for logging
+ */
+#define DECIM_RATIOS            {8, 6, 111}
+#define DECIM_MAX_RATIO         65535
+
+/*
+ * Values are on the 16 bit scale of data[] with DECIM_FRAC_BITS more
+ * below the point, the averaging makes them meaningful
+ */
+#define DECIM_FRAC_BITS         8
+
+/*
+ * Latest values of each output, and values a subscriber can have waiting
+ */
+#define DECIM_RING              256
+#define DECIM_QUEUE             16
+
+typedef struct DecimSub {
+  const char *name;
+  struct DecimSub *next;
+  unsigned stage;
+  bool_t enabled;                       /* gets values                      */
+  Mailbox mb;
+  msg_t mbBuf[DECIM_QUEUE];
+  uint32_t received;
+  uint32_t overruns;                    /* values missed, queue full        */
+} DecimSub;
+
+void decimInit(void);
+bool_t decimSubscribe(DecimSub *sub, unsigned stage, const char *name);
+void decimEnable(DecimSub *sub, bool_t enabled);
+bool_t decimFetch(DecimSub *sub, uint32_t *value, systime_t timeout);
+bool_t decimSetRatios(const uint32_t *ratios);
+
+void cmd_decim(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYDECIM_H_INCLUDED
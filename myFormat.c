@@ -0,0 +1,132 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myFormat.h"
+#include "myStream.h"
+#include "myTime.h"
+
+#if FMT_CHUNK_SIZE != STREAM_PACKET_SIZE
+#error "FMT_CHUNK_SIZE must be the stream's packet size"
+#endif
+
+/*
+ * Chunks go to the stream in ctx
+ */
+static void fmtStreamWrite(void *ctx, const char *p, size_t n) {
+
+  chSequentialStreamWrite((BaseSequentialStream *)ctx, (const uint8_t *)p, n);
+}
+
+/*
+ * prints n samples, each followed by sep
+ * (sep must be shorter than FMT_CHUNK_SIZE - FMT_U32_MAXLEN)
+ */
+void fmtWriteSamples(BaseSequentialStream *chp, const adcsample_t *v, size_t n,
+                     const char *sep, bool_t hex) {
+  FmtChunk c;
+  size_t i;
+
+  fmtChunkInit(&c, fmtStreamWrite, chp, sep, hex);
+  for (i = 0; i < n; i++)
+    fmtChunkPut(&c, v[i]);
+  fmtChunkFlush(&c);
+}
+
+void fmtWriteULongs(BaseSequentialStream *chp, const unsigned long *v, size_t n,
+                    const char *sep, bool_t hex) {
+  FmtChunk c;
+  size_t i;
+
+  fmtChunkInit(&c, fmtStreamWrite, chp, sep, hex);
+  for (i = 0; i < n; i++)
+    fmtChunkPut(&c, v[i]);
+  fmtChunkFlush(&c);
+}
+
+
+/*===========================================================================*/
+/* Benchmark against chprintf.                                               */
+/*===========================================================================*/
+
+#define FMTBENCH_COUNT  1024
+
+/*
+ * Stream that throws everything away, so only the formatting is measured
+ */
+static size_t nullWrite(void *ip, const uint8_t *bp, size_t n) {
+
+  (void)ip;
+  (void)bp;
+  return n;
+}
+
+static size_t nullRead(void *ip, uint8_t *bp, size_t n) {
+
+  (void)ip;
+  (void)bp;
+  (void)n;
+  return 0;
+}
+
+static msg_t nullPut(void *ip, uint8_t b) {
+
+  (void)ip;
+  (void)b;
+  return RDY_OK;
+}
+
+static msg_t nullGet(void *ip) {
+
+  (void)ip;
+  return RDY_RESET;
+}
+
+static const struct BaseSequentialStreamVMT nullVmt = {
+  nullWrite, nullRead, nullPut, nullGet
+};
+
+BaseSequentialStream fmtNullStream = {&nullVmt};
+
+/*
+ * formats FMTBENCH_COUNT samples with chprintf and with fmtWriteSamples
+ * and prints the CPU cycles per value for both
+ */
+void cmd_fmtbench(BaseSequentialStream *chp, int argc, char *argv[]) {
+  static adcsample_t values[FMTBENCH_COUNT];
+  uint32_t start, tPrintf, tFast, tPrintfHex, tFastHex;
+  unsigned int i;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: fmtbench\r\n");
+    return;
+  }
+  /* spread over the whole 12 bit range so all lengths show up */
+  for (i = 0; i < FMTBENCH_COUNT; i++)
+    values[i] = (i * 2657) & 0xFFF;
+
+  start = tsCycles();
+  for (i = 0; i < FMTBENCH_COUNT; i++)
+    chprintf(&fmtNullStream, "%d  ", values[i]);
+  tPrintf = tsCycles() - start;
+
+  start = tsCycles();
+  fmtWriteSamples(&fmtNullStream, values, FMTBENCH_COUNT, "  ", FALSE);
+  tFast = tsCycles() - start;
+
+  start = tsCycles();
+  for (i = 0; i < FMTBENCH_COUNT; i++)
+    chprintf(&fmtNullStream, "%x  ", values[i]);
+  tPrintfHex = tsCycles() - start;
+
+  start = tsCycles();
+  fmtWriteSamples(&fmtNullStream, values, FMTBENCH_COUNT, "  ", TRUE);
+  tFastHex = tsCycles() - start;
+
+  chprintf(chp, "cycles per value (%d values)\r\n", FMTBENCH_COUNT);
+  chprintf(chp, "dec chprintf : %U\r\n", tPrintf / FMTBENCH_COUNT);
+  chprintf(chp, "dec fast     : %U\r\n", tFast / FMTBENCH_COUNT);
+  chprintf(chp, "hex chprintf : %U\r\n", tPrintfHex / FMTBENCH_COUNT);
+  chprintf(chp, "hex fast     : %U\r\n", tFastHex / FMTBENCH_COUNT);
+}
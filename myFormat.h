@@ -0,0 +1,18 @@
+#ifndef MYFORMAT_H_INCLUDED
+#define MYFORMAT_H_INCLUDED
+
+#include "myFormatCore.h"
+
+/*
+ * Stream that throws everything away, for benchmarks
+ */
+extern BaseSequentialStream fmtNullStream;
+
+void fmtWriteSamples(BaseSequentialStream *chp, const adcsample_t *v, size_t n,
+                     const char *sep, bool_t hex);
+void fmtWriteULongs(BaseSequentialStream *chp, const unsigned long *v, size_t n,
+                    const char *sep, bool_t hex);
+
+void cmd_fmtbench(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYFORMAT_H_INCLUDED
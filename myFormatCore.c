@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "myFormatCore.h"
+
+
+/*
+ * "00" to "99", so two decimal digits are produced per division
+ */
+static const char digitPairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+/*
+ * writes v in decimal to p (not terminated) and returns the length
+ */
+size_t fmtU32(char *p, uint32_t v) {
+  char tmp[FMT_U32_MAXLEN];
+  char *t = tmp + FMT_U32_MAXLEN;
+  size_t len;
+
+  while (v >= 100) {
+    const char *d = &digitPairs[(v % 100) * 2];
+    v /= 100;
+    *--t = d[1];
+    *--t = d[0];
+  }
+  if (v >= 10) {
+    *--t = digitPairs[v * 2 + 1];
+    *--t = digitPairs[v * 2];
+  }
+  else
+    *--t = '0' + v;
+  len = tmp + FMT_U32_MAXLEN - t;
+  memcpy(p, t, len);
+  return len;
+}
+
+/*
+ * same for 64 bit values, nine digits at a time below the top ones
+ */
+size_t fmtU64(char *p, uint64_t v) {
+  char low[FMT_U32_MAXLEN];
+  size_t len, n;
+
+  if (v <= 0xffffffff)
+    return fmtU32(p, v);
+  len = fmtU64(p, v / 1000000000);
+  n = fmtU32(low, v % 1000000000);
+  memset(p + len, '0', 9 - n);
+  memcpy(p + len + 9 - n, low, n);
+  return len + 9;
+}
+
+/*
+ * writes v in uppercase hex without leading zeros, as chprintf's %x does,
+ * returns the length
+ */
+size_t fmtHex32(char *p, uint32_t v) {
+  size_t len = 1, i;
+
+  while (len < 8 && (v >> (len * 4)) != 0)
+    len++;
+  for (i = len; i > 0; i--) {
+    p[i - 1] = hexDigits[v & 0xF];
+    v >>= 4;
+  }
+  return len;
+}
+
+/*
+ * sep must be shorter than FMT_CHUNK_SIZE - FMT_U32_MAXLEN
+ */
+void fmtChunkInit(FmtChunk *c, fmtwrite_t write, void *ctx,
+                  const char *sep, int hex) {
+
+  c->write = write;
+  c->ctx = ctx;
+  c->sep = sep;
+  c->seplen = strlen(sep);
+  c->hex = hex;
+  c->n = 0;
+}
+
+void fmtChunkFlush(FmtChunk *c) {
+
+  if (c->n > 0)
+    c->write(c->ctx, c->buf, c->n);
+  c->n = 0;
+}
+
+void fmtChunkPut(FmtChunk *c, uint32_t v) {
+
+  if (c->n + FMT_U32_MAXLEN + c->seplen > sizeof(c->buf))
+    fmtChunkFlush(c);
+  if (c->hex)
+    c->n += fmtHex32(c->buf + c->n, v);
+  else
+    c->n += fmtU32(c->buf + c->n, v);
+  memcpy(c->buf + c->n, c->sep, c->seplen);
+  c->n += c->seplen;
+}
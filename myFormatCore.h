@@ -0,0 +1,48 @@
+#ifndef MYFORMATCORE_H_INCLUDED
+#define MYFORMATCORE_H_INCLUDED
+
+/*
+ * Number formatting and chunking behind myFormat.h.
+ * Plain C without ChibiOS dependencies, so it can be built natively.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Longest text fmtU32 or fmtHex32 can produce
+ */
+#define FMT_U32_MAXLEN  10
+#define FMT_U64_MAXLEN  20
+
+/*
+ * Chunk size, one USB packet (STREAM_PACKET_SIZE)
+ */
+#define FMT_CHUNK_SIZE  64
+
+size_t fmtU32(char *p, uint32_t v);
+size_t fmtU64(char *p, uint64_t v);
+size_t fmtHex32(char *p, uint32_t v);
+
+/*
+ * Formats one value plus separator at a time into a chunk, the chunk
+ * goes to write whenever the next value could not fit anymore
+ */
+typedef void (*fmtwrite_t)(void *ctx, const char *p, size_t n);
+
+typedef struct {
+  fmtwrite_t write;
+  void *ctx;
+  const char *sep;
+  size_t seplen;
+  int hex;
+  size_t n;
+  char buf[FMT_CHUNK_SIZE];
+} FmtChunk;
+
+void fmtChunkInit(FmtChunk *c, fmtwrite_t write, void *ctx,
+                  const char *sep, int hex);
+void fmtChunkPut(FmtChunk *c, uint32_t v);
+void fmtChunkFlush(FmtChunk *c);
+
+#endif // MYFORMATCORE_H_INCLUDED
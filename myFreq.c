@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myFreq.h"
+#include "myFormat.h"
+#include "myTime.h"
+#include "myLoad.h"
+
+#define FREQ_RING       (2 * FREQ_CAPTURES)
+#define FREQ_POLL       MS2ST(10)
+
+/*
+ * CCR1 is the 14th timer register, the burst reads it and CCR2
+ */
+#define FREQ_DCR        (STM32_TIM_DCR_DBL(1) | STM32_TIM_DCR_DBA(13))
+
+/*
+ * No callbacks, the ICU driver then leaves the capture interrupts off
+ */
+static const ICUConfig freqIcuCfg = {
+  ICU_INPUT_ACTIVE_HIGH,
+  FREQ_CLOCK,
+  NULL,
+  NULL,
+  NULL
+};
+
+static uint32_t freqRing[FREQ_RING];
+static const stm32_dma_stream_t *freqDma;
+
+/*
+ * State of the running measurement, changed with the system locked
+ */
+static FreqResult *freqResult;
+static uint64_t freqGateTicks;
+static size_t freqRd;
+static unsigned freqSkip;
+static bool_t freqDone;
+static Semaphore freqSem;
+
+/*
+ * Takes the captures the DMA wrote since the last call into the result
+ */
+static void freqConsumeI(void) {
+  size_t wr = (FREQ_RING - dmaStreamGetTransactionSize(freqDma)) & ~(size_t)1;
+  FreqResult *r = freqResult;
+  uint32_t period, half = r->binTicks / 2;
+  int32_t d;
+
+  while (freqRd != wr) {
+    period = freqRing[freqRd];
+    if (freqSkip == 0 && !freqDone) {
+      if (r->periods == 0)
+        r->ref = r->min = r->max = period;
+      if (period < r->min)
+        r->min = period;
+      if (period > r->max)
+        r->max = period;
+      /* rounded to the nearest bin, either side of ref alike */
+      d = (int32_t)(period - r->ref);
+      if (d >= 0)
+        d = (d + half) / r->binTicks;
+      else
+        d = -(int32_t)((-d + half) / r->binTicks);
+      d += FREQ_HIST_BINS / 2;
+      if (d < 0)
+        d = 0;
+      if (d >= FREQ_HIST_BINS)
+        d = FREQ_HIST_BINS - 1;
+      r->hist[d]++;
+      r->periods++;
+      r->ticks += period;
+      r->high += freqRing[freqRd + 1];
+      if (r->ticks >= freqGateTicks) {
+        freqDone = TRUE;
+        chSemSignalI(&freqSem);
+      }
+    }
+    else if (freqSkip > 0)
+      freqSkip--;
+    freqRd = (freqRd + 2) % FREQ_RING;
+  }
+}
+
+static void freqDmaIrq(void *p, uint32_t flags) {
+  TS_START(start);
+
+  (void)p;
+  (void)flags;
+  chSysLockFromIsr();
+  freqConsumeI();
+  chSysUnlockFromIsr();
+  loadIrq(LOAD_IRQ_FREQ, TS_ELAPSED(start));
+}
+
+/*
+ * Measures the input on PA0 for gateMs. binTicks is the width of the
+ * histogram bins in FREQ_CLOCK ticks. Returns FALSE if the DMA stream is
+ * taken, r->periods is 0 without edges.
+ */
+bool_t freqMeasure(uint32_t gateMs, uint32_t binTicks, FreqResult *r) {
+  systime_t start;
+
+  freqDma = STM32_DMA_STREAM(FREQ_DMA_STREAM);
+  if (dmaStreamAllocate(freqDma, FREQ_DMA_IRQ_PRIORITY, freqDmaIrq, NULL))
+    return FALSE;
+
+  memset(r, 0, sizeof(*r));
+  r->binTicks = binTicks;
+  freqResult = r;
+  freqGateTicks = (uint64_t)gateMs * (FREQ_CLOCK / 1000);
+  freqRd = 0;
+  /* the first capture counts from icuEnable, not from an edge */
+  freqSkip = 1;
+  freqDone = FALSE;
+  chSemInit(&freqSem, 0);
+
+  palSetPadMode(GPIOA, 0, PAL_MODE_ALTERNATE(2));
+  icuStart(&ICUD5, &freqIcuCfg);
+  /* the driver sets up a 16 bit timer, TIM5 has 32 */
+  ICUD5.tim->ARR = 0xFFFFFFFF;
+  ICUD5.tim->DCR = FREQ_DCR;
+  ICUD5.tim->DIER |= STM32_TIM_DIER_CC1DE;
+
+  dmaStreamSetPeripheral(freqDma, &ICUD5.tim->DMAR);
+  dmaStreamSetMemory0(freqDma, freqRing);
+  dmaStreamSetTransactionSize(freqDma, FREQ_RING);
+  dmaStreamSetMode(freqDma, STM32_DMA_CR_CHSEL(FREQ_DMA_CHANNEL) |
+                   STM32_DMA_CR_PL(FREQ_DMA_PRIORITY) | STM32_DMA_CR_DIR_P2M |
+                   STM32_DMA_CR_PSIZE_WORD | STM32_DMA_CR_MSIZE_WORD |
+                   STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC |
+                   STM32_DMA_CR_HTIE | STM32_DMA_CR_TCIE);
+  dmaStreamEnable(freqDma);
+  icuEnable(&ICUD5);
+
+  /* slow inputs never reach half the ring, they are polled */
+  start = chTimeNow();
+  while (chSemWaitTimeout(&freqSem, FREQ_POLL) != RDY_OK &&
+         chTimeElapsedSince(start) < MS2ST(gateMs + FREQ_MAX_PERIOD)) {
+    chSysLock();
+    freqConsumeI();
+    chSysUnlock();
+  }
+
+  chSysLock();
+  freqDone = TRUE;
+  r->lost = (ICUD5.tim->SR & STM32_TIM_SR_CC1OF) != 0;
+  chSysUnlock();
+  icuDisable(&ICUD5);
+  ICUD5.tim->DIER &= ~STM32_TIM_DIER_CC1DE;
+  dmaStreamDisable(freqDma);
+  dmaStreamRelease(freqDma);
+  icuStop(&ICUD5);
+  return TRUE;
+}
+
+/*
+ * prints a 0.1 ns value
+ */
+static void freqPrintNs(BaseSequentialStream *chp, uint64_t tenths) {
+  char buf[FMT_U64_MAXLEN + 1];
+
+  buf[fmtU64(buf, tenths / 10)] = 0;
+  chprintf(chp, "%s.%U ns", buf, (uint32_t)(tenths % 10));
+}
+
+/*
+ * measures frequency, period and duty cycle on PA0 over a gate of
+ * gate_ms, histogram bins are bin_ticks timer clocks wide
+ */
+void cmd_freq(BaseSequentialStream *chp, int argc, char *argv[]) {
+  static FreqResult r;
+  uint32_t gateMs = FREQ_GATE_DEFAULT, binTicks = 1, hz, mhz;
+  uint64_t n;
+  int i;
+
+  if (argc > 2) {
+    chprintf(chp, "Usage: freq [gate_ms [bin_ticks]]\r\n");
+    return;
+  }
+  if (argc > 0)
+    gateMs = strtoul(argv[0], NULL, 0);
+  if (argc > 1)
+    binTicks = strtoul(argv[1], NULL, 0);
+  if (gateMs == 0 || gateMs > FREQ_GATE_MAX || binTicks == 0) {
+    chprintf(chp, "gate 1..%U ms, bin_ticks at least 1\r\n", FREQ_GATE_MAX);
+    return;
+  }
+  if (!freqMeasure(gateMs, binTicks, &r)) {
+    chprintf(chp, "DMA stream busy\r\n");
+    return;
+  }
+  if (r.periods == 0) {
+    chprintf(chp, "no signal on PA0\r\n");
+    return;
+  }
+
+  n = (uint64_t)r.periods * FREQ_CLOCK;
+  hz = n / r.ticks;
+  mhz = (n % r.ticks) * 1000 / r.ticks;
+  chprintf(chp, "frequency : %U.%03U Hz, %U periods\r\n", hz, mhz, r.periods);
+  chprintf(chp, "period    : ");
+  freqPrintNs(chp, r.ticks * 10000 / (FREQ_CLOCK / 1000000) / r.periods);
+  chprintf(chp, ", min ");
+  freqPrintNs(chp, (uint64_t)r.min * 10000 / (FREQ_CLOCK / 1000000));
+  chprintf(chp, ", max ");
+  freqPrintNs(chp, (uint64_t)r.max * 10000 / (FREQ_CLOCK / 1000000));
+  chprintf(chp, "\r\n");
+  chprintf(chp, "duty      : %U.%02U %%\r\n", (uint32_t)(r.high * 100 / r.ticks),
+           (uint32_t)(r.high * 10000 / r.ticks % 100));
+  if (r.lost)
+    chprintf(chp, "edges lost, input too fast for the DMA\r\n");
+  chprintf(chp, "jitter    : bins of %U ticks around %U ticks\r\n", r.binTicks, r.ref);
+  for (i = 0; i < FREQ_HIST_BINS; i++)
+    if (r.hist[i])
+      chprintf(chp, "%5d %10U\r\n", i - FREQ_HIST_BINS / 2, r.hist[i]);
+}
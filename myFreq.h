@@ -0,0 +1,61 @@
+#ifndef MYFREQ_H_INCLUDED
+#define MYFREQ_H_INCLUDED
+
+/*
+ * Frequency, period and duty meter on PA0 (TIM5_CH1).
+ * The ICU driver puts TIM5 into PWM input mode: every rising edge resets
+ * the counter and latches the period into CCR1, every falling edge the
+ * high time into CCR2. Instead of the driver's per edge callbacks a DMA
+ * burst copies both registers into a ring on each rising edge, the ring
+ * is only looked at on half and full transfer and by the waiting command,
+ * which keeps inputs in the MHz range from drowning the CPU.
+ *
+ * The frequency is reciprocal: whole periods are summed until they cover
+ * the gate, so the resolution is one timer clock over the gate whatever
+ * the input frequency.
+ */
+
+/*
+ * TIM5 runs from the APB1 timer clock without prescaler, 32 bit
+ */
+#define FREQ_CLOCK              STM32_TIMCLK1
+
+/*
+ * Ring of captures, a period and a high time each
+ */
+#define FREQ_CAPTURES           512
+#define FREQ_DMA_STREAM         STM32_DMA_STREAM_ID(1, 2)
+#define FREQ_DMA_CHANNEL        6
+#define FREQ_DMA_PRIORITY       1
+#define FREQ_DMA_IRQ_PRIORITY   6
+
+/*
+ * Gate in ms if none is given and the longest one. A gate ends with the
+ * first edge after it, or FREQ_MAX_PERIOD later without one.
+ */
+#define FREQ_GATE_DEFAULT       1000
+#define FREQ_GATE_MAX           10000
+#define FREQ_MAX_PERIOD         1000
+
+/*
+ * Histogram of the periods around the first one of the gate, the outer
+ * bins also take everything beyond them
+ */
+#define FREQ_HIST_BINS          33
+
+typedef struct {
+  uint32_t periods;                     /* whole periods in the gate        */
+  uint64_t ticks;                       /* their length in FREQ_CLOCK ticks */
+  uint64_t high;                        /* of which the input was high      */
+  uint32_t min, max;                    /* shortest and longest period      */
+  uint32_t ref;                         /* period in the histogram's middle */
+  uint32_t binTicks;                    /* histogram bin width              */
+  uint32_t hist[FREQ_HIST_BINS];
+  bool_t lost;                          /* edges came faster than the DMA   */
+} FreqResult;
+
+bool_t freqMeasure(uint32_t gateMs, uint32_t binTicks, FreqResult *r);
+
+void cmd_freq(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYFREQ_H_INCLUDED
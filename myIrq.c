@@ -0,0 +1,41 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "myIrq.h"
+
+
+/*
+ * VTOR needs the table aligned to its size rounded up to a power of two
+ */
+static irqhandler_t vectors[IRQ_VECTORS] __attribute__((aligned(512)));
+
+/*
+ * Moves the vector table from flash to RAM, call it once before the
+ * first irqHook
+ */
+void irqInit(void) {
+  const irqhandler_t *flash = (const irqhandler_t *)SCB->VTOR;
+  unsigned i;
+
+  chSysLock();
+  for (i = 0; i < IRQ_VECTORS; i++)
+    vectors[i] = flash[i];
+  __DSB();
+  SCB->VTOR = (uint32_t)vectors;
+  __DSB();
+  chSysUnlock();
+}
+
+/*
+ * Installs a new handler for interrupt n, returns the previous one
+ */
+irqhandler_t irqHook(IRQn_Type n, irqhandler_t handler) {
+  irqhandler_t old;
+
+  chSysLock();
+  old = vectors[16 + n];
+  vectors[16 + n] = handler;
+  __DSB();
+  chSysUnlock();
+  return old;
+}
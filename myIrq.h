@@ -0,0 +1,24 @@
+#ifndef MYIRQ_H_INCLUDED
+#define MYIRQ_H_INCLUDED
+
+/*
+ * The interrupt vector table is copied to RAM at startup, so a handler
+ * ChibiOS installs can be replaced at run time.
+ * A replacement must be a complete CH_IRQ_HANDLER with its own
+ * CH_IRQ_PROLOGUE/CH_IRQ_EPILOGUE, doing whatever the replaced one did
+ * that is still needed. It must not call the replaced handler: the
+ * prologue takes LR for EXC_RETURN, which a plain call level replaces
+ * with a return address, and the epilogue then switches stacks wrongly.
+ */
+
+/*
+ * Cortex-M4 exceptions plus the 82 interrupts of the STM32F407
+ */
+#define IRQ_VECTORS             (16 + 82)
+
+typedef void (*irqhandler_t)(void);
+
+void irqInit(void);
+irqhandler_t irqHook(IRQn_Type n, irqhandler_t handler);
+
+#endif // MYIRQ_H_INCLUDED
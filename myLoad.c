@@ -0,0 +1,237 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myLoad.h"
+#include "myStack.h"
+#include "myTime.h"
+#include "myTrace.h"
+
+
+/*
+ * p_time deltas of one thread, in system ticks per slot
+ */
+typedef struct {
+  Thread *tp;                           /* NULL if the entry is free        */
+  const char *name;
+  tprio_t prio;
+  systime_t last;                       /* p_time at the last sample        */
+  bool_t seen;
+  uint16_t ticks[LOAD_SLOTS];
+} LoadThread;
+
+/*
+ * Time spent in the firmware's callbacks of one interrupt, added up by
+ * loadIrq. The drivers' own interrupt code around them is not included,
+ * nested interrupts count in both.
+ */
+typedef struct {
+  const char *name;
+  IRQn_Type irq;
+  /* updated by the interrupt, taken over by the monitor every period */
+  uint32_t count;
+  uint32_t cycles;
+  uint32_t max;
+  /* per slot */
+  uint32_t slotCount[LOAD_SLOTS];
+  uint32_t slotCycles[LOAD_SLOTS];
+} LoadIrq;
+
+/*
+ * In the order of the LOAD_IRQ_* indices
+ */
+static LoadIrq loadIrqs[] = {
+  {"adc dma", DMA2_Stream4_IRQn, 0, 0, 0, {0}, {0}},
+  {"usb", OTG_FS_IRQn, 0, 0, 0, {0}, {0}},
+  {"pwm", TIM2_IRQn, 0, 0, 0, {0}, {0}},
+  {"freq dma", DMA1_Stream2_IRQn, 0, 0, 0, {0}, {0}},
+};
+#define LOAD_IRQS       (sizeof(loadIrqs) / sizeof(loadIrqs[0]))
+
+static LoadThread loadThreads[LOAD_MAX_THREADS];
+static unsigned slot;
+static unsigned slotsFilled;
+static MUTEX_DECL(loadMutex);
+
+/*
+ * Called by a callback at its end with the cycles since its start
+ * (TS_START/TS_ELAPSED), from the interrupt
+ */
+void loadIrq(unsigned i, uint32_t cycles) {
+  LoadIrq *li = &loadIrqs[i];
+
+  traceIrq(li->irq, cycles);
+  li->count++;
+  li->cycles += cycles;
+  if (cycles > li->max)
+    li->max = cycles;
+}
+
+static LoadThread *loadFind(Thread *tp) {
+  LoadThread *empty = NULL;
+  unsigned i, j;
+
+  for (i = 0; i < LOAD_MAX_THREADS; i++) {
+    if (loadThreads[i].tp == tp)
+      return &loadThreads[i];
+    if (!empty && !loadThreads[i].tp)
+      empty = &loadThreads[i];
+  }
+  if (empty) {
+    empty->tp = tp;
+    empty->last = tp->p_time;
+    for (j = 0; j < LOAD_SLOTS; j++)
+      empty->ticks[j] = 0;
+  }
+  return empty;
+}
+
+/*
+ * Moves on by one slot and fills it
+ */
+static void loadSample(void) {
+  LoadThread *lt;
+  Thread *tp;
+  systime_t now;
+  unsigned i;
+
+  chMtxLock(&loadMutex);
+  slot = (slot + 1) % LOAD_SLOTS;
+  if (slotsFilled < LOAD_SLOTS)
+    slotsFilled++;
+
+  chSysLock();
+  for (i = 0; i < LOAD_IRQS; i++) {
+    loadIrqs[i].slotCount[slot] = loadIrqs[i].count;
+    loadIrqs[i].slotCycles[slot] = loadIrqs[i].cycles;
+    loadIrqs[i].count = 0;
+    loadIrqs[i].cycles = 0;
+  }
+  chSysUnlock();
+
+  for (i = 0; i < LOAD_MAX_THREADS; i++)
+    loadThreads[i].seen = FALSE;
+  tp = chRegFirstThread();
+  do {
+    lt = loadFind(tp);
+    if (lt) {
+      now = tp->p_time;
+      /* a new thread in the working area of a terminated one */
+      lt->ticks[slot] = now >= lt->last ? now - lt->last : now;
+      lt->last = now;
+      lt->name = tp->p_name;
+      lt->prio = tp->p_prio;
+      lt->seen = TRUE;
+    }
+    tp = chRegNextThread(tp);
+  } while (tp != NULL);
+  for (i = 0; i < LOAD_MAX_THREADS; i++)
+    if (!loadThreads[i].seen)
+      loadThreads[i].tp = NULL;
+  chMtxUnlock();
+}
+
+static WORKING_AREA(waLoad, 256);
+static msg_t loadThread(void *arg) {
+  systime_t next = chTimeNow();
+
+  (void)arg;
+  chRegSetThreadName("load");
+  while (TRUE) {
+    next += LOAD_PERIOD;
+    chThdSleepUntil(next);
+    loadSample();
+  }
+  return 0;
+}
+
+/*
+ * prints permille as a percentage with one decimal
+ */
+static void loadPrintPercent(BaseSequentialStream *chp, uint32_t permille) {
+
+  chprintf(chp, "%3U.%U%%", permille / 10, permille % 10);
+}
+
+/*
+ * top like overview of the last LOAD_SLOTS * LOAD_PERIOD
+ */
+void cmd_top(BaseSequentialStream *chp, int argc, char *argv[]) {
+  const char *names[LOAD_MAX_THREADS];
+  tprio_t prios[LOAD_MAX_THREADS];
+  uint32_t ticks[LOAD_MAX_THREADS];
+  uint32_t irqCount[LOAD_IRQS], irqCycles[LOAD_IRQS], irqMax[LOAD_IRQS];
+  uint32_t window, idle = 0, windowCycles;
+  unsigned i, j, n = 0;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: top\r\n");
+    return;
+  }
+
+  /* snapshot first, the monitor may sample while this is printed */
+  chMtxLock(&loadMutex);
+  window = slotsFilled * LOAD_PERIOD;
+  for (i = 0; i < LOAD_MAX_THREADS; i++) {
+    if (!loadThreads[i].tp)
+      continue;
+    names[n] = loadThreads[i].name ? loadThreads[i].name : "?";
+    prios[n] = loadThreads[i].prio;
+    ticks[n] = 0;
+    for (j = 0; j < LOAD_SLOTS; j++)
+      ticks[n] += loadThreads[i].ticks[j];
+    if (prios[n] == IDLEPRIO)
+      idle += ticks[n];
+    n++;
+  }
+  for (i = 0; i < LOAD_IRQS; i++) {
+    irqCount[i] = 0;
+    irqCycles[i] = 0;
+    for (j = 0; j < LOAD_SLOTS; j++) {
+      irqCount[i] += loadIrqs[i].slotCount[j];
+      irqCycles[i] += loadIrqs[i].slotCycles[j];
+    }
+    chSysLock();
+    irqMax[i] = loadIrqs[i].max;
+    loadIrqs[i].max = 0;
+    chSysUnlock();
+  }
+  chMtxUnlock();
+
+  if (window == 0) {
+    chprintf(chp, "No samples yet\r\n");
+    return;
+  }
+  chprintf(chp, "window %U ms\r\n", window * 1000 / CH_FREQUENCY);
+  chprintf(chp, "thread           prio    cpu\r\n");
+  for (i = 0; i < n; i++) {
+    chprintf(chp, "%-16s %4U ", names[i], (uint32_t)prios[i]);
+    loadPrintPercent(chp, ticks[i] * 1000 / window);
+    chprintf(chp, "\r\n");
+  }
+  /* interrupt time is also part of whatever thread it interrupted */
+  windowCycles = TS_TICKS_TO_CYCLES(window);
+  chprintf(chp, "interrupt     calls/s    cpu  max cycles\r\n");
+  for (i = 0; i < LOAD_IRQS; i++) {
+    chprintf(chp, "%-12s %8U ", loadIrqs[i].name,
+             irqCount[i] * CH_FREQUENCY / window);
+    loadPrintPercent(chp, (uint32_t)((uint64_t)irqCycles[i] * 1000 / windowCycles));
+    chprintf(chp, " %11U\r\n", irqMax[i]);
+  }
+  chprintf(chp, "headroom ");
+  loadPrintPercent(chp, idle * 1000 / window);
+  chprintf(chp, "\r\n");
+}
+
+/*
+ * Starts the monitor
+ */
+void loadInit(void) {
+  unsigned i;
+
+  for (i = 0; i < LOAD_IRQS; i++)
+    traceWatchIrq(loadIrqs[i].irq, loadIrqs[i].name);
+  stackWatch("load", waLoad, sizeof(waLoad));
+  chThdCreateStatic(waLoad, sizeof(waLoad), NORMALPRIO + 1, loadThread, NULL);
+}
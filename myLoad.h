@@ -0,0 +1,33 @@
+#ifndef MYLOAD_H_INCLUDED
+#define MYLOAD_H_INCLUDED
+
+/*
+ * CPU load monitor.
+ * Every LOAD_PERIOD the p_time of each thread (including idle) is sampled,
+ * the last LOAD_SLOTS deltas make up a sliding window. The callbacks the
+ * ADC DMA, USB, PWM and frequency DMA interrupts run are timed with the
+ * cycle counter and report to loadIrq, the drivers' own interrupt code
+ * is not part of it.
+ */
+#define LOAD_PERIOD             MS2ST(100)
+#define LOAD_SLOTS              10
+
+/*
+ * Threads that can be tracked at the same time
+ */
+#define LOAD_MAX_THREADS        12
+
+/*
+ * Interrupts for loadIrq
+ */
+#define LOAD_IRQ_ADC            0
+#define LOAD_IRQ_USB            1
+#define LOAD_IRQ_PWM            2
+#define LOAD_IRQ_FREQ           3
+
+void loadInit(void);
+void loadIrq(unsigned i, uint32_t cycles);
+
+void cmd_top(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYLOAD_H_INCLUDED
@@ -7,6 +7,8 @@
 #include "chprintf.h"
 
 #include "myMisc.h"
+#include "myStack.h"
+#include "myPool.h"
 
 
 /*===========================================================================*/
@@ -15,6 +17,7 @@
 
 
 void cmd_mem(BaseSequentialStream *chp, int argc, char *argv[]) {
+  PoolStats ps;
   size_t n, size;
 
   (void)argv;
@@ -26,6 +29,10 @@ void cmd_mem(BaseSequentialStream *chp, int argc, char *argv[]) {
   chprintf(chp, "core free memory : %u bytes\r\n", chCoreStatus());
   chprintf(chp, "heap fragments   : %u\r\n", n);
   chprintf(chp, "heap free total  : %u bytes\r\n", size);
+  poolGetStats(&ps);
+  chprintf(chp, "sample blocks    : %u of %u bytes\r\n", POOL_BLOCKS, POOL_BLOCK_SIZE);
+  chprintf(chp, "blocks used/free : %U/%U, peak %U\r\n", ps.used, POOL_BLOCKS - ps.used, ps.peak);
+  chprintf(chp, "block allocs     : %U, %U failed\r\n", ps.allocs, ps.failures);
 }
 
 void cmd_threads(BaseSequentialStream *chp, int argc, char *argv[]) {
@@ -100,5 +107,6 @@ static msg_t Thread1(void *arg) {
 }
 
 void startBlinker(void){
+  stackWatch("blinker", waThread1, sizeof(waThread1));
   chThdCreateStatic(waThread1, sizeof(waThread1), NORMALPRIO, Thread1, NULL);
 }
@@ -7,6 +7,11 @@ void cmd_threads(BaseSequentialStream *chp, int argc, char *argv[]);
 void cmd_toggle(BaseSequentialStream *chp, int argc, char *argv[]);
 void cmd_blinkspeed(BaseSequentialStream *chp, int argc, char *argv[]);
 
+/*
+ * blinker period [ms], 5...5000
+ */
+extern int blinkspeed;
+
 void startBlinker(void);
 
 
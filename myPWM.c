@@ -4,6 +4,9 @@
 #include <stdlib.h>
 
 #include "myPWM.h"
+#include "myTime.h"
+#include "myLoad.h"
+#include "myRec.h"
 
 
 /*
@@ -11,29 +14,38 @@
  * usually it resets all used channels (to either high or low)
  */
 
+static TsPeriod pwmPeriod;
+
 static void pwmpcb(PWMDriver *pwmp) {
+  TS_START(start);
 
   (void)pwmp;
+  tsPeriodUpdate(&pwmPeriod);
   palSetPad(GPIOD, GPIOD_LED4);
   palSetPad(GPIOD, GPIOD_LED5);
+  loadIrq(LOAD_IRQ_PWM, TS_ELAPSED(start));
 }
 
 /*
  * PWM callback for channel 1 at the given duty cycle
  */
 static void pwmc1cb(PWMDriver *pwmp) {
+  TS_START(start);
 
   (void)pwmp;
   palClearPad(GPIOD, GPIOD_LED4);
+  loadIrq(LOAD_IRQ_PWM, TS_ELAPSED(start));
 }
 
 /*
  * PWM callback for channel 2 at the given duty cycle
  */
 static void pwmc2cb(PWMDriver *pwmp) {
+  TS_START(start);
 
   (void)pwmp;
   palClearPad(GPIOD, GPIOD_LED5);
+  loadIrq(LOAD_IRQ_PWM, TS_ELAPSED(start));
 }
 
 /*
@@ -48,7 +60,7 @@ static PWMConfig pwmcfg = {
    {PWM_OUTPUT_ACTIVE_HIGH, pwmc1cb},       /* channel 1 callback at given duty cycle */
    {PWM_OUTPUT_ACTIVE_HIGH, pwmc2cb},       /* channel 2 callback at given duty cycle */
    {PWM_OUTPUT_DISABLED, NULL},             /* channel 1 callback unused */
-   {PWM_OUTPUT_DISABLED, NULL}              /* channel 1 callback unused */
+   {PWM_OUTPUT_ACTIVE_HIGH, NULL}           /* channel 4 triggers the ADC, no pin */
   },
   0,
 };
@@ -68,7 +80,8 @@ void cmd_cycle(BaseSequentialStream *chp, int argc, char *argv[]) {
   cycle = atoi(argv[0]);
   chprintf(chp, "cycle: %d\r\n", cycle);
   //pwmEnableChannel(&PWMD2, 0, PWM_PERCENTAGE_TO_WIDTH(&PWMD2, atoi(argv[0])));
-  pwmEnableChannel(&PWMD2, 0, atoi(argv[0]));
+  pwmEnableChannel(&PWMD2, 0, cycle);
+  recLog(REC_EV_PWM_WIDTH, 0, cycle);
 }
 
 
@@ -94,14 +107,74 @@ void cmd_ramp(BaseSequentialStream *chp, int argc, char *argv[]) {
   step = atoi(argv[2]);
   for(i=from;i<to;i+=step){
       pwmEnableChannel(&PWMD2, 0, i);
+      recLog(REC_EV_PWM_WIDTH, 0, i);
       chThdSleepMilliseconds(delay);
   }
 
 }
 
+/*
+ * Sets the phase of the ADC trigger in PWM ticks: OC4REF is high from the
+ * start of the period up to the compare value, its falling edge is the
+ * TIM2_CC4 event the ADC waits for. Valid phases are 1..period-1.
+ */
+bool_t mypwmTrigger(pwmcnt_t phase) {
+
+  if (phase == 0 || phase >= PWMD2.period)
+    return FALSE;
+  pwmEnableChannel(&PWMD2, 3, phase);
+  return TRUE;
+}
+
+void mypwmTriggerOff(void) {
+
+  pwmDisableChannel(&PWMD2, 3);
+}
+
+/*
+ * Width of channel 1 as last set by cycle or ramp
+ */
+pwmcnt_t mypwmDuty(void) {
+
+  return PWMD2.tim->CCR[0];
+}
+
+pwmcnt_t mypwmPeriod(void) {
+
+  return PWMD2.period;
+}
+
+/*
+ * PWM periods per second
+ */
+uint32_t mypwmRate(void) {
+
+  return pwmcfg.frequency / PWMD2.period;
+}
+
+/*
+ * Changes the period to 2..0xFFFF ticks (pwmcnt_t is 16 bit). Returns
+ * FALSE if the widths of channels 1 and 2 or an armed ADC trigger
+ * (1..period-1) would not fit into the new period.
+ */
+bool_t mypwmSetPeriod(uint32_t period) {
+  bool_t ok;
+
+  if (period < 2 || period > 0xFFFF)
+    return FALSE;
+  chSysLock();
+  ok = PWMD2.tim->CCR[0] <= period && PWMD2.tim->CCR[1] <= period &&
+       PWMD2.tim->CCR[3] < period;
+  if (ok)
+    pwmChangePeriodI(&PWMD2, period);
+  chSysUnlock();
+  return ok;
+}
+
 /*
  * starts the PWM device
  */
 void mypwmInit(void){
     pwmStart(&PWMD2, &pwmcfg);
+    tsWatch(&pwmPeriod, "pwm");
 }
@@ -3,6 +3,12 @@
 
 
 void mypwmInit(void);
+bool_t mypwmTrigger(pwmcnt_t phase);
+void mypwmTriggerOff(void);
+pwmcnt_t mypwmDuty(void);
+pwmcnt_t mypwmPeriod(void);
+bool_t mypwmSetPeriod(uint32_t period);
+uint32_t mypwmRate(void);
 void cmd_ramp(BaseSequentialStream *chp, int argc, char *argv[]);
 void cmd_cycle(BaseSequentialStream *chp, int argc, char *argv[]);
 
@@ -0,0 +1,76 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "myPool.h"
+#include "myBus.h"
+#include "myADC.h"
+
+#if POOL_BLOCKS < BUS_MSGS * BUS_BLOCKS + ADC_CAPTURE_BLOCKS
+#error "POOL_BLOCKS too small for a full capture next to the bus"
+#endif
+
+
+/*
+ * Word aligned for the DMA, POOL_BLOCK_SIZE keeps every block aligned too
+ */
+static adcsample_t poolArea[POOL_BLOCKS][POOL_BLOCK_SAMPLES]
+    __attribute__((aligned(4)));
+
+static MemoryPool pool;
+static PoolStats poolStats;
+
+/*
+ * Returns a block or NULL if the pool is empty, never waits
+ */
+adcsample_t *poolAllocI(void) {
+  adcsample_t *block;
+
+  block = chPoolAllocI(&pool);
+  if (!block) {
+    poolStats.failures++;
+    return NULL;
+  }
+  poolStats.allocs++;
+  if (++poolStats.used > poolStats.peak)
+    poolStats.peak = poolStats.used;
+  return block;
+}
+
+adcsample_t *poolAlloc(void) {
+  adcsample_t *block;
+
+  chSysLock();
+  block = poolAllocI();
+  chSysUnlock();
+  return block;
+}
+
+void poolFreeI(adcsample_t *block) {
+
+  chPoolFreeI(&pool, block);
+  poolStats.used--;
+}
+
+void poolFree(adcsample_t *block) {
+
+  chSysLock();
+  poolFreeI(block);
+  chSysUnlock();
+}
+
+/*
+ * Consistent copy of the statistics, resets the peak to the current use
+ */
+void poolGetStats(PoolStats *ps) {
+
+  chSysLock();
+  *ps = poolStats;
+  poolStats.peak = poolStats.used;
+  chSysUnlock();
+}
+
+void poolInit(void) {
+
+  chPoolInit(&pool, POOL_BLOCK_SIZE, NULL);
+  chPoolLoadArray(&pool, poolArea, POOL_BLOCKS);
+}
@@ -0,0 +1,38 @@
+#ifndef MYPOOL_H_INCLUDED
+#define MYPOOL_H_INCLUDED
+
+/*
+ * Fixed size sample blocks for DMA, processing and USB transmission.
+ * A ChibiOS memory pool over a static array, so alloc and free are O(1),
+ * work from threads and ISRs and never fragment like the heap does.
+ */
+
+/*
+ * Samples per block, 2 kB
+ */
+#define POOL_BLOCK_SAMPLES      1024
+#define POOL_BLOCK_SIZE         (POOL_BLOCK_SAMPLES * sizeof(adcsample_t))
+
+/*
+ * Enough for the bus (myBus.h) holding all its messages during a
+ * continuous conversion, 16 blocks, plus one full single scan capture
+ * (ADC_CAPTURE_MAX), 16 blocks, plus a few for whoever else needs one
+ * meanwhile. myPool.c checks it against both.
+ */
+#define POOL_BLOCKS             34
+
+typedef struct {
+  uint32_t used;                        /* blocks handed out right now      */
+  uint32_t peak;                        /* most blocks used at once         */
+  uint32_t allocs;
+  uint32_t failures;                    /* allocations with the pool empty  */
+} PoolStats;
+
+void poolInit(void);
+adcsample_t *poolAlloc(void);
+adcsample_t *poolAllocI(void);
+void poolFree(adcsample_t *block);
+void poolFreeI(adcsample_t *block);
+void poolGetStats(PoolStats *ps);
+
+#endif // MYPOOL_H_INCLUDED
@@ -0,0 +1,167 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "shell.h"
+#include "chprintf.h"
+
+#include "myProf.h"
+#include "myFormat.h"
+#include "myStream.h"
+#include "myTime.h"
+
+
+/*
+ * Commands that have been run since the last reset, in order of their
+ * first call
+ */
+static ProfEntry *profList;
+static ProfEntry **profTail = &profList;
+
+static unsigned profBin(uint64_t v) {
+  unsigned octave, bin;
+
+  if (v < (1ULL << PROF_HIST_FIRST))
+    return 0;
+  octave = 63 - __builtin_clzll(v);
+  bin = 1 + 2 * (octave - PROF_HIST_FIRST) + ((v >> (octave - 1)) & 1);
+  return bin < PROF_HIST_BINS ? bin : PROF_HIST_BINS - 1;
+}
+
+/*
+ * upper end of a histogram bin
+ */
+static uint64_t profBinLimit(unsigned bin) {
+  unsigned octave;
+
+  if (bin == 0)
+    return 1ULL << PROF_HIST_FIRST;
+  octave = PROF_HIST_FIRST + (bin - 1) / 2;
+  return (1ULL << octave) + ((uint64_t)((bin - 1) % 2 + 1) << (octave - 1));
+}
+
+static void profRecord(ProfEntry *pe, uint64_t cycles, uint64_t blocked) {
+  unsigned bin;
+
+  if (pe->count == 0) {
+    pe->next = NULL;
+    *profTail = pe;
+    profTail = &pe->next;
+    pe->min = cycles;
+  }
+  pe->count++;
+  if (cycles < pe->min)
+    pe->min = cycles;
+  if (cycles > pe->max)
+    pe->max = cycles;
+  pe->total += cycles;
+  if (blocked > pe->blockedMax)
+    pe->blockedMax = blocked;
+  pe->blockedTotal += blocked;
+  bin = profBin(cycles);
+  if (pe->hist[bin] < 0xffff)
+    pe->hist[bin]++;
+}
+
+/*
+ * Runs a command and records how long it took. Output still buffered
+ * when the command returns is sent first, so it counts as well.
+ */
+void profRun(ProfEntry *pe, shellcmd_t fn,
+             BaseSequentialStream *chp, int argc, char *argv[]) {
+  bool_t buffered = chp == (BaseSequentialStream *)&BSD1;
+  uint64_t blocked = buffered ? BSD1.blockedCycles : 0;
+  tstamp_t start;
+  uint64_t cycles;
+
+  start = tsNow();
+  fn(chp, argc, argv);
+  if (buffered)
+    bsFlush(&BSD1);
+  cycles = tsNow() - start;
+  blocked = buffered ? BSD1.blockedCycles - blocked : 0;
+  profRecord(pe, cycles, blocked);
+}
+
+/*
+ * upper end of the bin holding the 99th percentile, at most max
+ */
+static uint64_t profP99(const ProfEntry *pe) {
+  uint32_t rank = pe->count - pe->count / 100, seen = 0;
+  unsigned bin;
+
+  for (bin = 0; bin < PROF_HIST_BINS; bin++) {
+    seen += pe->hist[bin];
+    if (seen >= rank)
+      break;
+  }
+  /* the last bin also holds everything beyond it */
+  if (bin >= PROF_HIST_BINS - 1 || profBinLimit(bin) > pe->max)
+    return pe->max;
+  return profBinLimit(bin);
+}
+
+/*
+ * appends v right aligned in a column of width characters
+ */
+static size_t profColumn(char *p, uint64_t v, size_t width) {
+  char tmp[FMT_U64_MAXLEN];
+  size_t n = fmtU64(tmp, v), i = 0;
+
+  while (n + i < width)
+    p[i++] = ' ';
+  memcpy(p + i, tmp, n);
+  return i + n;
+}
+
+/*
+ * prints the execution times of all commands run since the last call,
+ * in DWT cycles, and resets them
+ */
+void cmd_prof(BaseSequentialStream *chp, int argc, char *argv[]) {
+  char line[24 + 7 * (FMT_U64_MAXLEN + 1) + 3];
+  ProfEntry *pe, *next;
+  size_t n;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: prof\r\n");
+    return;
+  }
+  chprintf(chp, "cycles at %U Hz, blocked is time waiting for the USB console\r\n",
+           TS_FREQUENCY);
+  chprintf(chp, "command                calls          min          avg"
+                "          max          p99  blocked avg  blocked max\r\n");
+  for (pe = profList; pe != NULL; pe = pe->next) {
+    n = 0;
+    while (pe->name[n] && n < 20) {
+      line[n] = pe->name[n];
+      n++;
+    }
+    while (n < 20)
+      line[n++] = ' ';
+    n += profColumn(line + n, pe->count, 8);
+    n += profColumn(line + n, pe->min, 13);
+    n += profColumn(line + n, pe->total / pe->count, 13);
+    n += profColumn(line + n, pe->max, 13);
+    n += profColumn(line + n, profP99(pe), 13);
+    n += profColumn(line + n, pe->blockedTotal / pe->count, 13);
+    n += profColumn(line + n, pe->blockedMax, 13);
+    line[n++] = '\r';
+    line[n++] = '\n';
+    chSequentialStreamWrite(chp, (const uint8_t *)line, n);
+  }
+  for (pe = profList; pe != NULL; pe = next) {
+    next = pe->next;
+    pe->count = 0;
+    pe->min = 0;
+    pe->max = 0;
+    pe->total = 0;
+    pe->blockedMax = 0;
+    pe->blockedTotal = 0;
+    for (n = 0; n < PROF_HIST_BINS; n++)
+      pe->hist[n] = 0;
+  }
+  profList = NULL;
+  profTail = &profList;
+}
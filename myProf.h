@@ -0,0 +1,45 @@
+#ifndef MYPROF_H_INCLUDED
+#define MYPROF_H_INCLUDED
+
+/*
+ * Per command execution profiling of the shell.
+ * Every entry of the command table goes through a small wrapper that
+ * measures the command in DWT cycles and how much of that time it was
+ * blocked writing to the USB console.
+ */
+
+/*
+ * p99 histogram: bin 0 takes everything below 2^PROF_HIST_FIRST cycles,
+ * above that each power of two is split into two bins
+ */
+#define PROF_HIST_FIRST         10
+#define PROF_HIST_BINS          (1 + 2 * (40 - PROF_HIST_FIRST))
+
+typedef struct ProfEntry {
+  const char *name;
+  struct ProfEntry *next;               /* list of commands run so far      */
+  uint32_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+  uint64_t blockedMax;
+  uint64_t blockedTotal;
+  uint16_t hist[PROF_HIST_BINS];
+} ProfEntry;
+
+void profRun(ProfEntry *pe, shellcmd_t fn,
+             BaseSequentialStream *chp, int argc, char *argv[]);
+
+/*
+ * PROF_WRAP(cmd_x) defines the wrapper, PROF(cmd_x) goes into the table
+ */
+#define PROF_WRAP(fn)                                                       \
+  static ProfEntry prof_##fn = {#fn, NULL, 0, 0, 0, 0, 0, 0, {0}};          \
+  static void profw_##fn(BaseSequentialStream *chp, int argc, char *argv[]) { \
+    profRun(&prof_##fn, fn, chp, argc, argv);                               \
+  }
+#define PROF(fn)                profw_##fn
+
+void cmd_prof(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYPROF_H_INCLUDED
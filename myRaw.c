@@ -0,0 +1,125 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myRaw.h"
+#include "myData.h"
+#include "myADC.h"
+#include "myPool.h"
+#include "myBus.h"
+#include "myTime.h"
+#include "myStack.h"
+
+#if MY_USE_DATA_CHANNEL
+
+static BusSub rawSub;
+
+static bool_t rawOn;
+static uint32_t rawSent;
+static uint32_t rawFailed;
+
+/*
+ * Sends the half buffers from the bus, the data channel is taken for each
+ * one so the RPC server still gets its turn (its answers end up between
+ * the packets). seq is the bus's, half buffers the bus could not hand
+ * over and packets that could not be sent show up as gaps in it.
+ */
+static WORKING_AREA(waRaw, 256);
+static msg_t rawThread(void *arg) {
+  uint8_t header[RAW_HEADER_SIZE];
+  RawHeader rh;
+  BusMsg *m;
+  size_t samples, i, len;
+  bool_t ok;
+
+  (void)arg;
+  chRegSetThreadName("raw");
+  while (TRUE) {
+    m = busFetch(&rawSub, TIME_INFINITE);
+    /* switched off with packets still queued */
+    if (!rawOn) {
+      busRelease(m);
+      continue;
+    }
+    rh.magic = RAW_MAGIC;
+    rh.seq = m->seq;
+    rh.time = m->time;
+    rh.frequency = TS_FREQUENCY;
+    rh.channels = RAW_CHANNELS;
+    rh.sequences = m->sequences;
+    rh.dropped = rawSub.overruns + rawFailed;
+    rh.reserved = 0;
+    rh.vrefSum = m->hk.vref;
+    rh.tempSum = m->hk.temp;
+    rh.hkCount = m->hk.count;
+    rh.vrefLast = m->hk.vrefLast;
+    rh.tempLast = m->hk.tempLast;
+    rawPutHeader(header, &rh);
+    samples = m->sequences * RAW_CHANNELS;
+    /* a packet is larger than the queue, so it cannot wait for room for
+       all of it; a short write ends it and counts as failed instead */
+    chMtxLock(&DCH1.lock);
+    ok = dataWriteTimeout(&DCH1, header, RAW_HEADER_SIZE,
+                          RAW_TX_TIMEOUT) == RAW_HEADER_SIZE;
+    for (i = 0; ok && i * POOL_BLOCK_SAMPLES < samples; i++) {
+      len = samples - i * POOL_BLOCK_SAMPLES;
+      if (len > POOL_BLOCK_SAMPLES)
+        len = POOL_BLOCK_SAMPLES;
+      /* adcsample_t is little endian already */
+      len *= sizeof(adcsample_t);
+      ok = dataWriteTimeout(&DCH1, (const uint8_t *)m->blocks[i], len,
+                            RAW_TX_TIMEOUT) == len;
+    }
+    chMtxUnlock();
+    busRelease(m);
+    if (!ok)
+      rawFailed++;
+    else
+      rawSent++;
+  }
+  return 0;
+}
+
+/*
+ * switches the stream on or off, prints its statistics
+ */
+void cmd_raw(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  if (argc > 1 || (argc == 1 && strcmp(argv[0], "on") != 0 &&
+                   strcmp(argv[0], "off") != 0)) {
+    chprintf(chp, "Usage: raw [on|off]\r\n");
+    return;
+  }
+  if (argc == 1 && strcmp(argv[0], "on") == 0) {
+    chSysLock();
+    rawSub.overruns = 0;
+    rawFailed = 0;
+    rawSent = 0;
+    rawOn = TRUE;
+    chSysUnlock();
+    busEnable(&rawSub, TRUE);
+    if (!myADCrunning())
+      chprintf(chp, "Stream starts with mc\r\n");
+  }
+  else if (argc == 1) {
+    busEnable(&rawSub, FALSE);
+    rawOn = FALSE;
+  }
+  chprintf(chp, "stream  : %s\r\n", rawOn ? "on" : "off");
+  chprintf(chp, "packets : %U sent, %U dropped\r\n", rawSent,
+           rawSub.overruns + rawFailed);
+}
+
+/*
+ * Needs busInit first
+ */
+void rawInit(void) {
+
+  busSubscribe(&rawSub, "raw");
+  stackWatch("raw", waRaw, sizeof(waRaw));
+  chThdCreateStatic(waRaw, sizeof(waRaw), NORMALPRIO, rawThread, NULL);
+}
+
+#endif /* MY_USE_DATA_CHANNEL */
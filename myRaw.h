@@ -0,0 +1,24 @@
+#ifndef MYRAW_H_INCLUDED
+#define MYRAW_H_INCLUDED
+
+/*
+ * Raw sample stream of the continuous conversion over the data channel,
+ * for host/capd. A thread subscribed to the block bus (myBus.h) sends
+ * every half buffer. The packet format is in myRawProto.h.
+ */
+#if MY_USE_DATA_CHANNEL
+
+#include "myRawProto.h"
+
+/*
+ * A packet that cannot be queued within this time is dropped
+ */
+#define RAW_TX_TIMEOUT          MS2ST(500)
+
+void rawInit(void);
+
+void cmd_raw(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif /* MY_USE_DATA_CHANNEL */
+
+#endif // MYRAW_H_INCLUDED
@@ -0,0 +1,116 @@
+#ifndef MYRAWPROTO_H_INCLUDED
+#define MYRAWPROTO_H_INCLUDED
+
+/*
+ * Raw sample stream of the continuous conversion on the data channel.
+ * Plain C without ChibiOS dependencies, shared with the host tools, which
+ * also store the packets unchanged as the chunks of a capture file
+ * (host/capfile.h).
+ *
+ * Every half buffer of the conversion becomes one packet:
+ *   magic u32, seq u32, time u64, frequency u32, channels u16,
+ *   sequences u16, dropped u32, reserved u32,
+ *   housekeeping: vref sum u32, temp sum u32, count u16, vref last u16,
+ *   temp last u16, reserved u16,
+ *   then channels * sequences samples u16, one sequence after the other
+ * All little endian. time is the cycle counter (tsNow) when the half
+ * buffer was complete, frequency its rate. seq counts every half buffer,
+ * including those dropped because USB or the host was too slow, dropped
+ * is the number of those so far. The housekeeping fields are the
+ * injected VREFINT and temperature conversions of the half buffer
+ * (AdcHousekeeping in myADCPipe.h).
+ */
+
+#include <stdint.h>
+
+#define RAW_MAGIC               0x32574152      /* "RAW2"                   */
+#define RAW_HEADER_SIZE         48
+
+/*
+ * ADC channel of every sample of a sequence: 8 x PC1 (IN11)
+ */
+#define RAW_CHANNELS            8
+#define RAW_CHANNEL_LAYOUT      {11, 11, 11, 11, 11, 11, 11, 11}
+
+/*
+ * Sanity limit for the host, a packet never carries more
+ */
+#define RAW_MAX_SAMPLES         16384
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+  uint64_t time;
+  uint32_t frequency;
+  uint16_t channels;
+  uint16_t sequences;
+  uint32_t dropped;
+  uint32_t reserved;
+  uint32_t vrefSum;
+  uint32_t tempSum;
+  uint16_t hkCount;
+  uint16_t vrefLast;
+  uint16_t tempLast;
+} RawHeader;
+
+static inline void rawPut16(uint8_t *p, uint16_t v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void rawPut32(uint8_t *p, uint32_t v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline uint16_t rawGet16(const uint8_t *p) {
+
+  return p[0] | p[1] << 8;
+}
+
+static inline uint32_t rawGet32(const uint8_t *p) {
+
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void rawPutHeader(uint8_t *p, const RawHeader *h) {
+
+  rawPut32(p, h->magic);
+  rawPut32(p + 4, h->seq);
+  rawPut32(p + 8, (uint32_t)h->time);
+  rawPut32(p + 12, (uint32_t)(h->time >> 32));
+  rawPut32(p + 16, h->frequency);
+  rawPut16(p + 20, h->channels);
+  rawPut16(p + 22, h->sequences);
+  rawPut32(p + 24, h->dropped);
+  rawPut32(p + 28, h->reserved);
+  rawPut32(p + 32, h->vrefSum);
+  rawPut32(p + 36, h->tempSum);
+  rawPut16(p + 40, h->hkCount);
+  rawPut16(p + 42, h->vrefLast);
+  rawPut16(p + 44, h->tempLast);
+  rawPut16(p + 46, 0);
+}
+
+static inline void rawGetHeader(RawHeader *h, const uint8_t *p) {
+
+  h->magic = rawGet32(p);
+  h->seq = rawGet32(p + 4);
+  h->time = rawGet32(p + 8) | (uint64_t)rawGet32(p + 12) << 32;
+  h->frequency = rawGet32(p + 16);
+  h->channels = rawGet16(p + 20);
+  h->sequences = rawGet16(p + 22);
+  h->dropped = rawGet32(p + 24);
+  h->reserved = rawGet32(p + 28);
+  h->vrefSum = rawGet32(p + 32);
+  h->tempSum = rawGet32(p + 36);
+  h->hkCount = rawGet16(p + 40);
+  h->vrefLast = rawGet16(p + 42);
+  h->tempLast = rawGet16(p + 44);
+}
+
+#endif // MYRAWPROTO_H_INCLUDED
@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myRec.h"
+
+
+/*
+ * Keeps the ring of the previous boot and starts a new one
+ */
+void recInit(void) {
+
+  if (REC_RING->magic == REC_MAGIC)
+    memcpy(REC_LAST, REC_RING, sizeof(RecRing));
+  else
+    REC_LAST->magic = 0;
+  REC_RING->head = 0;
+  REC_RING->fault = FALSE;
+  REC_RING->magic = REC_MAGIC;
+  recLog(REC_EV_BOOT, RCC->CSR, 0);
+  RCC->CSR |= RCC_CSR_RMVF;
+}
+
+/*
+ * Called by the fault handlers with the exception stack frame
+ */
+void recFault(uint32_t *frame) {
+
+  recLog(REC_EV_FAULT, frame[6], SCB->CFSR);
+  REC_RING->fault = TRUE;
+  NVIC_SystemReset();
+}
+
+/*
+ * Replace the weak defaults of the 2.5 port's vectors.c (HardFaultVector
+ * and friends, not the CMSIS names), they pass whichever stack was
+ * active to recFault
+ */
+#define REC_FAULT_HANDLER(name)                                             \
+  void name(void) __attribute__((naked));                                   \
+  void name(void) {                                                         \
+    asm volatile ("tst    lr, #4      \n"                                   \
+                  "ite    eq          \n"                                   \
+                  "mrseq  r0, msp     \n"                                   \
+                  "mrsne  r0, psp     \n"                                   \
+                  "b      recFault    \n");                                 \
+  }
+
+REC_FAULT_HANDLER(HardFaultVector)
+REC_FAULT_HANDLER(MemManageVector)
+REC_FAULT_HANDLER(BusFaultVector)
+REC_FAULT_HANDLER(UsageFaultVector)
+
+/*
+ * SYSTEM_HALT_HOOK, a failed kernel check or assertion
+ */
+void recPanic(void) {
+
+#if CH_DBG_SYSTEM_STATE_CHECK || CH_DBG_ENABLE_CHECKS ||                    \
+    CH_DBG_ENABLE_ASSERTS || CH_DBG_ENABLE_STACK_CHECK
+  recLog(REC_EV_PANIC, (uint32_t)dbg_panic_msg, 0);
+#else
+  recLog(REC_EV_PANIC, 0, 0);
+#endif
+  REC_RING->fault = TRUE;
+  NVIC_SystemReset();
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+/*
+ * Writes "REC <bytes>", the raw events and "REC END" for host/recdump.
+ * The ring keeps being written meanwhile, the seq field tells the host
+ * which events were overwritten under its feet.
+ */
+void cmd_rec(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint8_t header[REC_HEADER_SIZE];
+  const RecRing *ring = REC_RING;
+  uint32_t head, count, n;
+
+  if (argc > 1 || (argc == 1 && strcmp(argv[0], "last") != 0)) {
+    chprintf(chp, "Usage: rec [last]\r\n");
+    return;
+  }
+  if (argc == 1) {
+    ring = REC_LAST;
+    if (ring->magic != REC_MAGIC) {
+      chprintf(chp, "No recording of a previous boot\r\n");
+      return;
+    }
+  }
+  head = ring->head;
+  count = head < REC_EVENTS ? head : REC_EVENTS;
+  chprintf(chp, "REC %U\r\n", REC_HEADER_SIZE + count * REC_EVENT_SIZE);
+  put32(header, REC_MAGIC);
+  put32(header + 4, TS_FREQUENCY);
+  put32(header + 8, head);
+  put32(header + 12, ring->fault);
+  put32(header + 16, count);
+  chSequentialStreamWrite(chp, header, REC_HEADER_SIZE);
+  /* the events are little endian already, as they are on the host */
+  for (n = head - count; n != head; n++)
+    chSequentialStreamWrite(chp, (const uint8_t *)&ring->ev[n % REC_EVENTS],
+                            REC_EVENT_SIZE);
+  chprintf(chp, "\r\nREC END\r\n");
+}
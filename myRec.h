@@ -0,0 +1,67 @@
+#ifndef MYREC_H_INCLUDED
+#define MYREC_H_INCLUDED
+
+/*
+ * Flight recorder, a ring of small binary events that any context can
+ * write with a handful of instructions: the slot is claimed with
+ * LDREX/STREX, so there is no lock and interrupts stay enabled.
+ * The ring lives in the core coupled RAM, which the linker script leaves
+ * alone (STM32F407xG.ld, not the _CCM variant) and a reset does not clear.
+ * Faults and kernel panics record an event and reset the board, the ring
+ * of the previous boot can then be dumped with "rec last".
+ * Event ids and the dump format are in myRecEvents.h.
+ */
+
+#include "myRecEvents.h"
+#include "myTime.h"
+
+/*
+ * Events per ring, a power of two
+ */
+#define REC_EVENTS              1024
+
+typedef struct {
+  uint32_t time;
+  uint16_t id;
+  uint16_t seq;
+  uint32_t a;
+  uint32_t b;
+} RecEvent;
+
+typedef struct {
+  uint32_t magic;
+  volatile uint32_t head;               /* number of the next event         */
+  uint32_t fault;                       /* TRUE if it ended in a fault      */
+  RecEvent ev[REC_EVENTS];
+} RecRing;
+
+/*
+ * The current ring and the one of the previous boot, 32 kB of the 64 kB
+ * core coupled RAM
+ */
+#define REC_CCM_BASE            0x10000000
+#define REC_RING                ((RecRing *)REC_CCM_BASE)
+#define REC_LAST                ((RecRing *)REC_CCM_BASE + 1)
+
+static inline void recLog(uint16_t id, uint32_t a, uint32_t b) {
+  RecEvent *ev;
+  uint32_t n;
+
+  do {
+    n = __LDREXW(&REC_RING->head);
+  } while (__STREXW(n + 1, &REC_RING->head));
+  ev = &REC_RING->ev[n % REC_EVENTS];
+  ev->time = tsCycles();
+  ev->id = id;
+  ev->a = a;
+  ev->b = b;
+  __DMB();
+  ev->seq = (uint16_t)n;
+}
+
+void recInit(void);
+void recPanic(void);
+
+void cmd_rec(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYREC_H_INCLUDED
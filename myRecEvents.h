@@ -0,0 +1,51 @@
+#ifndef MYRECEVENTS_H_INCLUDED
+#define MYRECEVENTS_H_INCLUDED
+
+/*
+ * Flight recorder events and dump format.
+ * Plain C without ChibiOS dependencies, host/recdump.c builds against
+ * this very file, so the device never has to format anything.
+ *
+ * Dump, all little endian:
+ *   header  magic u32, frequency u32, head u32 (events logged so far),
+ *           fault u32, event count u32
+ *   event   time u32 (cycle counter), id u16, seq u16, a u32, b u32
+ * seq is the low half of the event's number and written last, an event
+ * whose seq does not match its position was being overwritten during the
+ * dump and has to be skipped.
+ */
+
+#include <stdint.h>
+
+#define REC_MAGIC               0x31434552      /* "REC1"                   */
+#define REC_HEADER_SIZE         20
+#define REC_EVENT_SIZE          16
+
+/*
+ * Event ids, the two arguments follow each name
+ */
+#define REC_EV_BOOT             0       /* RCC_CSR reset flags, -           */
+#define REC_EV_TIME             1       /* tsNow() high, low word           */
+#define REC_EV_FAULT            2       /* stacked pc, CFSR                 */
+#define REC_EV_PANIC            3       /* message address, -               */
+#define REC_EV_ADC_HALF         4       /* samples, ring position p1        */
+#define REC_EV_ADC_OVERFLOW     5       /* overflow count, p1               */
+#define REC_EV_ADC_ERROR        6       /* adcerror_t, overflow count       */
+#define REC_EV_ADC_READ_ERROR   7       /* ring position p2, value          */
+#define REC_EV_ADC_START        8       /* 1 resumed after one-shot, -      */
+#define REC_EV_ADC_STOP         9       /* 1 paused for one-shot, -         */
+#define REC_EV_PWM_WIDTH        10      /* channel, width                   */
+#define REC_EV_PWM_PERIOD       11      /* period, -                        */
+#define REC_EV_USB              12      /* usbevent_t, -                    */
+#define REC_EV_ADC_LIMIT        13      /* channel << 16 | value, above     */
+#define REC_EV_COUNT            14
+
+/*
+ * Names by id, like THD_STATE_NAMES
+ */
+#define REC_EV_NAMES                                                        \
+  "boot", "time", "fault", "panic", "adc half", "adc overflow",              \
+  "adc error", "adc read error", "adc start", "adc stop", "pwm width",       \
+  "pwm period", "usb", "adc limit"
+
+#endif // MYRECEVENTS_H_INCLUDED
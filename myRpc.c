@@ -0,0 +1,298 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myRpc.h"
+#include "myRpcProto.h"
+#include "myData.h"
+#include "myADC.h"
+#include "myPWM.h"
+#include "myMisc.h"
+#include "myStack.h"
+#include "myRec.h"
+
+#if MY_USE_DATA_CHANNEL
+
+/*
+ * Frame being received (still COBS encoded) and the response being sent
+ */
+static uint8_t rxFrame[RPC_COBS_SIZE(RPC_MAX_FRAME)];
+static size_t rxLen;
+static bool_t rxOverrun;
+static uint8_t rxChunk[64];
+static uint8_t txMsg[RPC_MAX_FRAME];
+static uint8_t txFrame[RPC_COBS_SIZE(RPC_MAX_FRAME)];
+
+/*
+ * The last capture, read back by RPC_OP_ADC_READ. Its pool blocks go
+ * back when its last sample has been read, with the next capture or
+ * after RPC_CAPTURE_IDLE without a read.
+ */
+static AdcCapture captured;
+static systime_t capturedUsed;
+
+/*
+ * statistics
+ */
+static uint32_t requests;
+static uint32_t crcErrors;
+static uint32_t frameErrors;
+static uint32_t dropped;
+
+static uint8_t rpcPwmSet(const uint8_t *in, size_t n) {
+  uint32_t width;
+
+  if (n != 5 || in[0] > 1)
+    return RPC_E_ARGS;
+  width = rpcGet32(in + 1);
+  if (width > PWMD2.period)
+    return RPC_E_ARGS;
+  pwmEnableChannel(&PWMD2, in[0], width);
+  recLog(REC_EV_PWM_WIDTH, in[0], width);
+  return RPC_OK;
+}
+
+static uint8_t rpcAdcCapture(const uint8_t *in, size_t n, uint8_t *out, size_t *outn) {
+  uint32_t sum = 0;
+  adcsample_t min = 0xffff, max = 0, v;
+  size_t count, i;
+
+  if (n != 2)
+    return RPC_E_ARGS;
+  count = rpcGet16(in);
+  if (count == 0 || count > ADC_CAPTURE_MAX)
+    return RPC_E_ARGS;
+  myADCrelease(&captured);
+  if (!myADCcapture(&captured, count))
+    return RPC_E_BUSY;
+  capturedUsed = chTimeNow();
+  for (i = 0; i < count; i++) {
+    v = ADC_CAPTURE_AT(&captured, i);
+    sum += v;
+    if (v < min)
+      min = v;
+    if (v > max)
+      max = v;
+  }
+  rpcPut16(out, count);
+  rpcPut32(out + 2, sum);
+  rpcPut16(out + 6, min);
+  rpcPut16(out + 8, max);
+  *outn = 10;
+  return RPC_OK;
+}
+
+static uint8_t rpcAdcRead(const uint8_t *in, size_t n, uint8_t *out, size_t *outn) {
+  size_t offset, count, i;
+
+  if (n != 4)
+    return RPC_E_ARGS;
+  offset = rpcGet16(in);
+  count = rpcGet16(in + 2);
+  if (count > RPC_MAX_PAYLOAD / 2 || offset + count > captured.n)
+    return RPC_E_ARGS;
+  for (i = 0; i < count; i++)
+    rpcPut16(out + 2 * i, ADC_CAPTURE_AT(&captured, offset + i));
+  *outn = 2 * count;
+  capturedUsed = chTimeNow();
+  if (count > 0 && offset + count == captured.n)
+    myADCrelease(&captured);
+  return RPC_OK;
+}
+
+static uint8_t rpcStats(size_t n, uint8_t *out, size_t *outn) {
+  uint32_t v[RPC_STAT_COUNT];
+  size_t i;
+
+  if (n != 0)
+    return RPC_E_ARGS;
+  v[RPC_STAT_UPTIME] = chTimeNow() * 1000 / CH_FREQUENCY;
+  v[RPC_STAT_REQUESTS] = requests;
+  v[RPC_STAT_CRC_ERRORS] = crcErrors;
+  v[RPC_STAT_FRAME_ERRORS] = frameErrors;
+  v[RPC_STAT_DATA_SENT] = DCH1.sent;
+  v[RPC_STAT_DATA_RECEIVED] = DCH1.received;
+  v[RPC_STAT_ADC_RUNNING] = myADCrunning();
+  v[RPC_STAT_ADC_OVERFLOW] = overflow;
+  for (i = 0; i < RPC_STAT_COUNT; i++)
+    rpcPut32(out + 4 * i, v[i]);
+  *outn = 4 * RPC_STAT_COUNT;
+  return RPC_OK;
+}
+
+static uint8_t rpcConfigGet(const uint8_t *in, size_t n, uint8_t *out, size_t *outn) {
+  uint32_t value;
+
+  if (n != 1)
+    return RPC_E_ARGS;
+  switch (in[0]) {
+  case RPC_CFG_PWM_PERIOD:
+    value = PWMD2.period;
+    break;
+  case RPC_CFG_VREF:
+    value = VREFMeasured;
+    break;
+  case RPC_CFG_BLINK:
+    value = blinkspeed;
+    break;
+  default:
+    return RPC_E_ARGS;
+  }
+  rpcPut32(out, value);
+  *outn = 4;
+  return RPC_OK;
+}
+
+static uint8_t rpcConfigSet(const uint8_t *in, size_t n) {
+  uint32_t value;
+
+  if (n != 5)
+    return RPC_E_ARGS;
+  value = rpcGet32(in + 1);
+  switch (in[0]) {
+  case RPC_CFG_PWM_PERIOD:
+    if (!mypwmSetPeriod(value))
+      return RPC_E_ARGS;
+    recLog(REC_EV_PWM_PERIOD, value, 0);
+    return RPC_OK;
+  case RPC_CFG_VREF:
+    if (value == 0)
+      return RPC_E_ARGS;
+    VREFMeasured = value;
+    return RPC_OK;
+  case RPC_CFG_BLINK:
+    if (value < 5 || value > 5000)
+      return RPC_E_ARGS;
+    blinkspeed = value;
+    return RPC_OK;
+  }
+  return RPC_E_ARGS;
+}
+
+/*
+ * Runs one request, returns the status and fills in the response payload
+ */
+static uint8_t rpcExecute(uint8_t op, const uint8_t *in, size_t n,
+                          uint8_t *out, size_t *outn) {
+  size_t i;
+
+  *outn = 0;
+  switch (op) {
+  case RPC_OP_PING:
+    if (n > RPC_MAX_PAYLOAD)
+      return RPC_E_ARGS;
+    for (i = 0; i < n; i++)
+      out[i] = in[i];
+    *outn = n;
+    return RPC_OK;
+  case RPC_OP_PWM_SET:
+    return rpcPwmSet(in, n);
+  case RPC_OP_ADC_CAPTURE:
+    return rpcAdcCapture(in, n, out, outn);
+  case RPC_OP_ADC_READ:
+    return rpcAdcRead(in, n, out, outn);
+  case RPC_OP_STATS:
+    return rpcStats(n, out, outn);
+  case RPC_OP_CONFIG_GET:
+    return rpcConfigGet(in, n, out, outn);
+  case RPC_OP_CONFIG_SET:
+    return rpcConfigSet(in, n);
+  }
+  return RPC_E_OP;
+}
+
+/*
+ * Checks and answers the frame in rxFrame
+ */
+static void rpcProcess(void) {
+  size_t outn, len;
+  int n;
+
+  n = rpcUnframe(rxFrame, rxLen);
+  if (n == -2) {
+    crcErrors++;
+    return;
+  }
+  if (n < RPC_REQUEST_HEADER) {
+    frameErrors++;
+    return;
+  }
+  requests++;
+  txMsg[0] = rxFrame[0];
+  txMsg[1] = rxFrame[1];
+  txMsg[2] = rxFrame[2] | RPC_RESPONSE_FLAG;
+  txMsg[3] = rpcExecute(rxFrame[2], rxFrame + RPC_REQUEST_HEADER,
+                        n - RPC_REQUEST_HEADER, txMsg + RPC_RESPONSE_HEADER, &outn);
+  len = rpcFrame(txFrame, txMsg, RPC_RESPONSE_HEADER + outn);
+  if (dataWriteTimeout(&DCH1, txFrame, len, RPC_TX_TIMEOUT) != len)
+    dropped++;
+}
+
+/*
+ * Collects bytes up to the next delimiter, an overlong frame is dropped
+ */
+static void rpcInput(const uint8_t *p, size_t n) {
+
+  while (n--) {
+    if (*p == 0) {
+      if (rxOverrun)
+        frameErrors++;
+      else if (rxLen > 0)
+        rpcProcess();
+      rxLen = 0;
+      rxOverrun = FALSE;
+    }
+    else if (rxLen < sizeof(rxFrame))
+      rxFrame[rxLen++] = *p;
+    else
+      rxOverrun = TRUE;
+    p++;
+  }
+}
+
+/*
+ * RPC server thread, owns the data channel except while usbbench has it
+ */
+static WORKING_AREA(waRpc, 512);
+static msg_t rpcThread(void *arg) {
+  size_t n;
+
+  (void)arg;
+  chRegSetThreadName("rpc");
+  while (TRUE) {
+    chMtxLock(&DCH1.lock);
+    n = dataReadTimeout(&DCH1, rxChunk, 1, RPC_POLL_TIME);
+    if (n > 0) {
+      n += dataReadTimeout(&DCH1, rxChunk + 1, sizeof(rxChunk) - 1, TIME_IMMEDIATE);
+      rpcInput(rxChunk, n);
+    }
+    chMtxUnlock();
+    if (captured.n > 0 && chTimeElapsedSince(capturedUsed) >= RPC_CAPTURE_IDLE)
+      myADCrelease(&captured);
+  }
+  return 0;
+}
+
+/*
+ * prints the RPC server statistics
+ */
+void cmd_rpc(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: rpc\r\n");
+    return;
+  }
+  chprintf(chp, "requests          : %U\r\n", requests);
+  chprintf(chp, "crc errors        : %U\r\n", crcErrors);
+  chprintf(chp, "frame errors      : %U\r\n", frameErrors);
+  chprintf(chp, "dropped responses : %U\r\n", dropped);
+}
+
+void rpcInit(void) {
+
+  stackWatch("rpc", waRpc, sizeof(waRpc));
+  chThdCreateStatic(waRpc, sizeof(waRpc), NORMALPRIO, rpcThread, NULL);
+}
+
+#endif /* MY_USE_DATA_CHANNEL */
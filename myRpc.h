@@ -0,0 +1,34 @@
+#ifndef MYRPC_H_INCLUDED
+#define MYRPC_H_INCLUDED
+
+/*
+ * Binary RPC server on the data channel, the machine readable sibling of
+ * the shell. The protocol is described in myRpcProto.h, the host side is
+ * host/rpc.c.
+ */
+#if MY_USE_DATA_CHANNEL
+
+/*
+ * The server waits at most this long for data before it gives the data
+ * channel to someone else (usbbench)
+ */
+#define RPC_POLL_TIME           MS2ST(20)
+
+/*
+ * A response that cannot be queued within this time is dropped
+ */
+#define RPC_TX_TIMEOUT          MS2ST(500)
+
+/*
+ * A capture that has not been read from for this long gives its pool
+ * blocks back
+ */
+#define RPC_CAPTURE_IDLE        MS2ST(5000)
+
+void rpcInit(void);
+
+void cmd_rpc(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif /* MY_USE_DATA_CHANNEL */
+
+#endif // MYRPC_H_INCLUDED
@@ -0,0 +1,78 @@
+#include "myRpcProto.h"
+
+
+/*
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff), four bits at a time,
+ * a compromise between a 512 byte table and eight shifts per byte
+ */
+static const uint16_t crcNibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+uint16_t rpcCrc16(const uint8_t *p, size_t n) {
+  uint16_t crc = 0xffff;
+
+  while (n--) {
+    crc = (crc << 4) ^ crcNibble[(crc >> 12) ^ (*p >> 4)];
+    crc = (crc << 4) ^ crcNibble[(crc >> 12) ^ (*p++ & 0x0f)];
+  }
+  return crc;
+}
+
+/*
+ * Appends the CRC to msg (which needs room for it), COBS encodes the
+ * result into out and terminates it with the 0x00 delimiter.
+ * out needs RPC_COBS_SIZE(n + RPC_CRC_SIZE) bytes, returns the bytes used.
+ */
+size_t rpcFrame(uint8_t *out, uint8_t *msg, size_t n) {
+  size_t code = 0, o = 1, i;
+
+  rpcPut16(msg + n, rpcCrc16(msg, n));
+  n += RPC_CRC_SIZE;
+  for (i = 0; i < n; i++) {
+    if (msg[i] == 0) {
+      out[code] = o - code;
+      code = o++;
+    }
+    else {
+      out[o++] = msg[i];
+      if (o - code == 0xff) {
+        out[code] = 0xff;
+        code = o++;
+      }
+    }
+  }
+  out[code] = o - code;
+  out[o++] = 0;
+  return o;
+}
+
+/*
+ * Decodes a frame (without its delimiter) in place and checks the CRC.
+ * Returns the message length without the CRC, -1 for broken COBS and
+ * -2 for a wrong CRC.
+ */
+int rpcUnframe(uint8_t *frame, size_t n) {
+  size_t i = 0, o = 0, end;
+  uint8_t code;
+
+  while (i < n) {
+    code = frame[i++];
+    if (code == 0)
+      return -1;
+    end = i + code - 1;
+    if (end > n)
+      return -1;
+    while (i < end)
+      frame[o++] = frame[i++];
+    if (code != 0xff && i < n)
+      frame[o++] = 0;
+  }
+  if (o < RPC_CRC_SIZE)
+    return -1;
+  o -= RPC_CRC_SIZE;
+  if (rpcGet16(frame + o) != rpcCrc16(frame, o))
+    return -2;
+  return o;
+}
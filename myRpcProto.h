@@ -0,0 +1,109 @@
+#ifndef MYRPCPROTO_H_INCLUDED
+#define MYRPCPROTO_H_INCLUDED
+
+/*
+ * Binary RPC protocol on the data channel.
+ * Plain C without ChibiOS dependencies, the host library in host/ builds
+ * this very file, so both sides always agree on the format.
+ *
+ * Every message is one frame: COBS encoded, terminated by a 0x00 byte.
+ * Decoded it is
+ *   request : id (2) | op (1)          | payload | crc (2)
+ *   response: id (2) | op|0x80 (1) | status (1) | payload | crc (2)
+ * All numbers are little endian, the CRC is CRC-16/CCITT-FALSE over
+ * everything before it. The id is chosen by the host and copied into the
+ * response, so several requests can be in flight at once. The device
+ * answers them in the order they arrive.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RPC_MAX_PAYLOAD         512
+#define RPC_REQUEST_HEADER      3
+#define RPC_RESPONSE_HEADER     4
+#define RPC_CRC_SIZE            2
+/*
+ * Largest decoded frame, a response with a full payload
+ */
+#define RPC_MAX_FRAME           (RPC_RESPONSE_HEADER + RPC_MAX_PAYLOAD + RPC_CRC_SIZE)
+/*
+ * COBS adds one byte per started 254 bytes, plus the delimiter
+ */
+#define RPC_COBS_SIZE(n)        ((n) + (n) / 254 + 2)
+
+#define RPC_RESPONSE_FLAG       0x80
+
+/*
+ * Operations, the payload layout follows each name
+ */
+#define RPC_OP_PING             0x00    /* any -> the same bytes            */
+#define RPC_OP_PWM_SET          0x01    /* channel u8, width u32 -> none    */
+#define RPC_OP_ADC_CAPTURE      0x02    /* count u16 ->
+                                           count u16, sum u32, min u16, max u16 */
+#define RPC_OP_ADC_READ         0x03    /* offset u16, count u16 ->
+                                           count samples u16 of the last capture,
+                                           released by the read of its last
+                                           sample or 5 s without a read */
+#define RPC_OP_STATS            0x04    /* none -> RPC_STAT_COUNT u32       */
+#define RPC_OP_CONFIG_GET       0x05    /* key u8 -> value u32              */
+#define RPC_OP_CONFIG_SET       0x06    /* key u8, value u32 -> none        */
+
+/*
+ * Response status
+ */
+#define RPC_OK                  0
+#define RPC_E_OP                1       /* unknown operation                */
+#define RPC_E_ARGS              2       /* wrong payload length or value    */
+#define RPC_E_BUSY              3       /* ADC busy or no blocks            */
+
+/*
+ * Keys of RPC_OP_CONFIG_GET/SET
+ */
+#define RPC_CFG_PWM_PERIOD      0       /* PWM period in 1 us ticks, 2..65535,
+                                           not below the channel widths */
+#define RPC_CFG_VREF            1       /* measured VREFINT, see vref       */
+#define RPC_CFG_BLINK           2       /* blinker period [ms]              */
+
+/*
+ * Order of the values returned by RPC_OP_STATS
+ */
+#define RPC_STAT_UPTIME         0       /* ms since boot                    */
+#define RPC_STAT_REQUESTS       1       /* frames that passed the CRC       */
+#define RPC_STAT_CRC_ERRORS     2
+#define RPC_STAT_FRAME_ERRORS   3       /* broken COBS, too long or short   */
+#define RPC_STAT_DATA_SENT      4       /* bytes of the data channel        */
+#define RPC_STAT_DATA_RECEIVED  5
+#define RPC_STAT_ADC_RUNNING    6       /* mc is running                    */
+#define RPC_STAT_ADC_OVERFLOW   7
+#define RPC_STAT_COUNT          8
+
+static inline uint16_t rpcGet16(const uint8_t *p) {
+
+  return p[0] | (uint16_t)p[1] << 8;
+}
+
+static inline uint32_t rpcGet32(const uint8_t *p) {
+
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void rpcPut16(uint8_t *p, uint16_t v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void rpcPut32(uint8_t *p, uint32_t v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+uint16_t rpcCrc16(const uint8_t *p, size_t n);
+size_t rpcFrame(uint8_t *out, uint8_t *msg, size_t n);
+int rpcUnframe(uint8_t *frame, size_t n);
+
+#endif // MYRPCPROTO_H_INCLUDED
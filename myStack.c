@@ -0,0 +1,119 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myStack.h"
+
+
+/*
+ * Interrupt (main) and main thread (process) stacks, from the linker script
+ */
+extern uint8_t __main_stack_base__[], __main_stack_end__[];
+extern uint8_t __process_stack_base__[], __process_stack_end__[];
+
+/*
+ * Idle thread working area, from chsys.c
+ */
+extern WORKING_AREA(_idle_thread_wa, PORT_IDLE_THREAD_STACK_SIZE);
+
+typedef struct {
+  const char *name;
+  const uint8_t *stack;                 /* lowest address, grows down to it */
+  size_t stackSize;
+  size_t size;                          /* working area incl. Thread        */
+  size_t peak;                          /* at the last scan                 */
+  size_t worst;                         /* highest peak since boot          */
+} StackArea;
+
+static StackArea stackAreas[STACK_MAX_AREAS];
+static unsigned stackCount;
+
+static void stackAdd(const char *name, const void *stack, size_t stackSize,
+                     size_t size) {
+  StackArea *sa;
+
+  if (stackCount >= STACK_MAX_AREAS)
+    return;
+  sa = &stackAreas[stackCount++];
+  sa->name = name;
+  sa->stack = stack;
+  sa->stackSize = stackSize;
+  sa->size = size;
+  sa->peak = 0;
+  sa->worst = 0;
+}
+
+/*
+ * Watches the working area of a thread, the Thread structure sits at its
+ * bottom and the stack above it
+ */
+void stackWatch(const char *name, void *wa, size_t size) {
+
+  stackAdd(name, (uint8_t *)wa + sizeof(Thread), size - sizeof(Thread), size);
+}
+
+/*
+ * Bytes used so far, counting the untouched pattern from the bottom up
+ */
+static size_t stackPeak(const StackArea *sa) {
+  size_t unused = 0;
+
+  while (unused < sa->stackSize && sa->stack[unused] == CH_STACK_FILL_VALUE)
+    unused++;
+  return sa->stackSize - unused;
+}
+
+/*
+ * Updates the peaks. Also called before a working area gets reused (and
+ * refilled), so its worst case survives.
+ */
+void stackScan(void) {
+  unsigned i;
+
+  for (i = 0; i < stackCount; i++) {
+    stackAreas[i].peak = stackPeak(&stackAreas[i]);
+    if (stackAreas[i].peak > stackAreas[i].worst)
+      stackAreas[i].worst = stackAreas[i].peak;
+  }
+}
+
+/*
+ * prints peak usage and margin of every watched stack
+ */
+void cmd_stack(BaseSequentialStream *chp, int argc, char *argv[]) {
+  const StackArea *sa;
+  size_t suggest;
+  unsigned i;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: stack\r\n");
+    return;
+  }
+  stackScan();
+  chprintf(chp, "area           size  stack   peak margin  worst suggest\r\n");
+  for (i = 0; i < stackCount; i++) {
+    sa = &stackAreas[i];
+    /* worst case plus a quarter, rounded to the stack alignment */
+    suggest = sa->size - sa->stackSize + sa->worst + sa->worst / 4;
+    suggest = (suggest + sizeof(stkalign_t) - 1) & ~(sizeof(stkalign_t) - 1);
+    chprintf(chp, "%-12s %6U %6U %6U %6U %6U %6U%s\r\n",
+             sa->name, sa->size, sa->stackSize, sa->peak,
+             sa->stackSize - sa->peak, sa->worst, suggest,
+             sa->worst == sa->stackSize ? "  OVERFLOW?" : "");
+  }
+}
+
+/*
+ * Watches the stacks that exist before any module starts a thread
+ */
+void stackInit(void) {
+
+  stackAdd("irq", __main_stack_base__,
+           __main_stack_end__ - __main_stack_base__,
+           __main_stack_end__ - __main_stack_base__);
+  stackAdd("main", __process_stack_base__,
+           __process_stack_end__ - __process_stack_base__,
+           __process_stack_end__ - __process_stack_base__);
+  stackWatch("idle", _idle_thread_wa, sizeof(_idle_thread_wa));
+}
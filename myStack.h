@@ -0,0 +1,22 @@
+#ifndef MYSTACK_H_INCLUDED
+#define MYSTACK_H_INCLUDED
+
+/*
+ * Stack usage analysis.
+ * Working areas are filled with CH_STACK_FILL_VALUE when a thread is
+ * created (CH_DBG_FILL_THREADS), the interrupt and main stacks by the
+ * startup code. Whatever still holds the pattern has never been used.
+ */
+
+/*
+ * Areas that can be watched
+ */
+#define STACK_MAX_AREAS         12
+
+void stackInit(void);
+void stackWatch(const char *name, void *wa, size_t size);
+void stackScan(void);
+
+void cmd_stack(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYSTACK_H_INCLUDED
@@ -0,0 +1,184 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myStream.h"
+#include "myTime.h"
+#include "myStack.h"
+
+
+/*
+ * Buffered stream in front of the serial over USB driver, used by the shell
+ */
+BufferedStream BSD1;
+
+/*
+ * Hands the buffered bytes to the underlying stream as one packet,
+ * with the lock held
+ */
+static void flush(BufferedStream *bsp) {
+  systime_t start;
+  tstamp_t cycles;
+
+  if (bsp->n == 0)
+    return;
+  chSysLock();
+  if (chVTIsArmedI(&bsp->timer))
+    chVTResetI(&bsp->timer);
+  chSysUnlock();
+  start = chTimeNow();
+  cycles = tsNow();
+  chSequentialStreamWrite(bsp->out, bsp->buf, bsp->n);
+  bsp->blockedCycles += tsNow() - cycles;
+  bsp->blocked += chTimeNow() - start;
+  bsp->bytes += bsp->n;
+  bsp->packets++;
+  if (bsp->n == STREAM_PACKET_SIZE)
+    bsp->fullPackets++;
+  bsp->n = 0;
+}
+
+void bsFlush(BufferedStream *bsp) {
+
+  chMtxLock(&bsp->lock);
+  flush(bsp);
+  chMtxUnlock();
+}
+
+/*
+ * The oldest buffered byte reached STREAM_FLUSH_TIMEOUT
+ */
+static void bsTimeout(void *arg) {
+  BufferedStream *bsp = arg;
+
+  chSysLockFromIsr();
+  chBSemSignalI(&bsp->timeout);
+  chSysUnlockFromIsr();
+}
+
+/*
+ * Sends what the timer found waiting. A timeout that fired just before a
+ * writer's flush only sends the next buffer early.
+ */
+static WORKING_AREA(waStream, 256);
+static msg_t bsThread(void *arg) {
+  BufferedStream *bsp = arg;
+
+  chRegSetThreadName("stream");
+  while (TRUE) {
+    chBSemWait(&bsp->timeout);
+    bsFlush(bsp);
+  }
+  return 0;
+}
+
+/*
+ * Copies data into the buffer, sending every full packet.
+ * A newline causes a flush, the first buffered byte arms the timeout.
+ */
+static size_t write(void *ip, const uint8_t *bp, size_t n) {
+  BufferedStream *bsp = ip;
+  size_t i;
+  bool_t newline = FALSE;
+
+  chMtxLock(&bsp->lock);
+  for (i = 0; i < n; i++) {
+    if (bsp->n == 0) {
+      chSysLock();
+      chVTSetI(&bsp->timer, STREAM_FLUSH_TIMEOUT, bsTimeout, bsp);
+      chSysUnlock();
+    }
+    bsp->buf[bsp->n++] = bp[i];
+    if (bp[i] == '\n')
+      newline = TRUE;
+    if (bsp->n == STREAM_PACKET_SIZE)
+      flush(bsp);
+  }
+  if (newline)
+    flush(bsp);
+  chMtxUnlock();
+  return n;
+}
+
+/*
+ * Anything still buffered is sent before blocking on input, so the shell
+ * echo and prompt always show up.
+ */
+static size_t read(void *ip, uint8_t *bp, size_t n) {
+  BufferedStream *bsp = ip;
+
+  bsFlush(bsp);
+  return chSequentialStreamRead(bsp->out, bp, n);
+}
+
+static msg_t put(void *ip, uint8_t b) {
+
+  write(ip, &b, 1);
+  return RDY_OK;
+}
+
+static msg_t get(void *ip) {
+  BufferedStream *bsp = ip;
+
+  bsFlush(bsp);
+  return chSequentialStreamGet(bsp->out);
+}
+
+static const struct BaseSequentialStreamVMT vmt = {write, read, put, get};
+
+void bsResetStats(BufferedStream *bsp) {
+
+  bsp->bytes = 0;
+  bsp->packets = 0;
+  bsp->fullPackets = 0;
+  bsp->blocked = 0;
+  bsp->since = chTimeNow();
+}
+
+/*
+ * Also starts the flusher thread, its working area is there once (BSD1)
+ */
+void bsObjectInit(BufferedStream *bsp, BaseSequentialStream *out) {
+
+  bsp->vmt = &vmt;
+  bsp->out = out;
+  chMtxInit(&bsp->lock);
+  chBSemInit(&bsp->timeout, TRUE);
+  bsp->n = 0;
+  bsp->blockedCycles = 0;
+  bsResetStats(bsp);
+  stackWatch("stream", waStream, sizeof(waStream));
+  chThdCreateStatic(waStream, sizeof(waStream), NORMALPRIO, bsThread, bsp);
+}
+
+/*
+ * prints the packet statistics of the shell stream and resets them
+ */
+void cmd_stream(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t bytes, packets, full, blocked, elapsed;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: stream\r\n");
+    return;
+  }
+  /* take a snapshot first, printing it changes the numbers */
+  bytes = BSD1.bytes;
+  packets = BSD1.packets;
+  full = BSD1.fullPackets;
+  blocked = BSD1.blocked;
+  elapsed = chTimeNow() - BSD1.since;
+  if (elapsed == 0)
+    elapsed = 1;
+  chprintf(chp, "bytes            : %U\r\n", bytes);
+  chprintf(chp, "packets          : %U (%U full)\r\n", packets, full);
+  if (packets)
+    chprintf(chp, "bytes per packet : %U\r\n", bytes / packets);
+  chprintf(chp, "throughput       : %U bytes/s\r\n",
+           (uint32_t)((uint64_t)bytes * CH_FREQUENCY / elapsed));
+  chprintf(chp, "blocked on USB   : %U of %U ms\r\n",
+           blocked * 1000 / CH_FREQUENCY, elapsed * 1000 / CH_FREQUENCY);
+  bsResetStats(&BSD1);
+}
@@ -0,0 +1,45 @@
+#ifndef MYSTREAM_H_INCLUDED
+#define MYSTREAM_H_INCLUDED
+
+/*
+ * Size of the coalescing buffer, one full bulk packet (see ep1config)
+ */
+#define STREAM_PACKET_SIZE      64
+
+/*
+ * Age of a partially filled buffer after which it is sent anyway. A timer
+ * armed by the first buffered byte wakes the stream's flusher thread, so
+ * output without a newline shows up even if nothing else is written.
+ */
+#define STREAM_FLUSH_TIMEOUT    MS2ST(20)
+
+/*
+ * Buffering BaseSequentialStream that collects small writes into full
+ * packets before handing them to the underlying stream
+ */
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  BaseSequentialStream *out;            /* underlying stream (SDU1)         */
+  Mutex lock;                           /* buffer, writers and the flusher  */
+  VirtualTimer timer;                   /* armed while bytes are buffered   */
+  BinarySemaphore timeout;              /* signaled by the timer            */
+  uint8_t buf[STREAM_PACKET_SIZE];
+  size_t n;                             /* bytes currently buffered         */
+  uint64_t blockedCycles;               /* never reset, for the profiler    */
+  /* statistics since the last reset */
+  uint32_t bytes;
+  uint32_t packets;
+  uint32_t fullPackets;
+  uint32_t blocked;                     /* time in the out stream [ticks]   */
+  systime_t since;
+} BufferedStream;
+
+extern BufferedStream BSD1;
+
+void bsObjectInit(BufferedStream *bsp, BaseSequentialStream *out);
+void bsFlush(BufferedStream *bsp);
+void bsResetStats(BufferedStream *bsp);
+
+void cmd_stream(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYSTREAM_H_INCLUDED
@@ -0,0 +1,147 @@
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myTime.h"
+#include "myFormat.h"
+#include "myRec.h"
+
+
+/*
+ * Upper 32 bits and the counter value they belong to
+ */
+static uint32_t tsHigh;
+static uint32_t tsLast;
+
+static VirtualTimer tsTimer;
+
+static TsPeriod *tsPeriods[TS_MAX_PERIODS];
+static unsigned tsPeriodCount;
+
+/*
+ * Interrupts are disabled for a few cycles (PRIMASK, not just the kernel
+ * lock), so this works from every context
+ */
+tstamp_t tsNow(void) {
+  uint32_t primask = __get_PRIMASK();
+  uint32_t now, high;
+
+  __disable_irq();
+  now = tsCycles();
+  if (now < tsLast)
+    tsHigh++;
+  tsLast = now;
+  high = tsHigh;
+  __set_PRIMASK(primask);
+  return (tstamp_t)high << 32 | now;
+}
+
+uint64_t tsToUs(tstamp_t t) {
+
+  return t / TS_CYCLES_PER_US;
+}
+
+uint32_t tsToMs(tstamp_t t) {
+
+  return t / (TS_FREQUENCY / 1000);
+}
+
+/*
+ * Keeps tsHigh up to date when nobody asks for the time
+ */
+static void tsRefresh(void *arg) {
+  tstamp_t now;
+
+  (void)arg;
+  now = tsNow();
+  /* lets the host put the recorder's 32 bit times on one time line */
+  recLog(REC_EV_TIME, now >> 32, (uint32_t)now);
+  chSysLockFromIsr();
+  chVTSetI(&tsTimer, TS_REFRESH, tsRefresh, NULL);
+  chSysUnlockFromIsr();
+}
+
+/*
+ * Records the time since the previous call, the first call only starts
+ */
+void tsPeriodUpdate(TsPeriod *tp) {
+  tstamp_t now = tsNow();
+  uint32_t period;
+
+  if (tp->last != 0) {
+    period = now - tp->last;
+    if (tp->count == 0 || period < tp->min)
+      tp->min = period;
+    if (period > tp->max)
+      tp->max = period;
+    tp->total += period;
+    tp->count++;
+  }
+  tp->last = now;
+}
+
+/*
+ * Makes a period show up in the ts command
+ */
+void tsWatch(TsPeriod *tp, const char *name) {
+
+  tp->name = name;
+  if (tsPeriodCount < TS_MAX_PERIODS)
+    tsPeriods[tsPeriodCount++] = tp;
+}
+
+/*
+ * prints the current timestamp and the watched periods in us, then
+ * resets the periods
+ */
+void cmd_ts(BaseSequentialStream *chp, int argc, char *argv[]) {
+  char buf[FMT_U64_MAXLEN + 1];
+  tstamp_t now = tsNow();
+  TsPeriod snap;
+  unsigned i;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: ts\r\n");
+    return;
+  }
+  buf[fmtU64(buf, now)] = 0;
+  chprintf(chp, "cycles     : %s at %U Hz\r\n", buf, TS_FREQUENCY);
+  buf[fmtU64(buf, tsToUs(now))] = 0;
+  chprintf(chp, "uptime     : %s us\r\n", buf);
+  if (tsPeriodCount > 0)
+    chprintf(chp, "period        count     min us     avg us     max us\r\n");
+  for (i = 0; i < tsPeriodCount; i++) {
+    /* the callbacks update them from ISRs */
+    chSysLock();
+    snap = *tsPeriods[i];
+    tsPeriods[i]->count = 0;
+    tsPeriods[i]->min = 0;
+    tsPeriods[i]->max = 0;
+    tsPeriods[i]->total = 0;
+    chSysUnlock();
+    if (snap.count == 0) {
+      chprintf(chp, "%-10s %8U          -          -          -\r\n", snap.name, 0);
+      continue;
+    }
+    chprintf(chp, "%-10s %8U %10U %10U %10U\r\n", snap.name, snap.count,
+             TS_CYCLES_TO_US(snap.min),
+             (uint32_t)tsToUs(snap.total / snap.count),
+             TS_CYCLES_TO_US(snap.max));
+  }
+}
+
+/*
+ * Starts the cycle counter (ChibiOS does too, this does not depend on it)
+ * and the refresh timer
+ */
+void tsInit(void) {
+
+  SCS_DEMCR |= SCS_DEMCR_TRCENA;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+  tsLast = tsCycles();
+  recLog(REC_EV_TIME, 0, tsLast);
+  chSysLock();
+  chVTSetI(&tsTimer, TS_REFRESH, tsRefresh, NULL);
+  chSysUnlock();
+}
@@ -0,0 +1,68 @@
+#ifndef MYTIME_H_INCLUDED
+#define MYTIME_H_INCLUDED
+
+/*
+ * High resolution timestamps from the DWT cycle counter.
+ * chTimeNow() only has CH_FREQUENCY (1 ms) resolution, this counts CPU
+ * cycles. tsNow() extends the 32 bit counter (wraps after 25 s) to 64 bit
+ * and may be called from any context, ISRs above the kernel priority
+ * included. Short intervals can use the raw 32 bit counter directly.
+ */
+
+typedef uint64_t tstamp_t;
+
+#define TS_FREQUENCY            STM32_HCLK
+
+/*
+ * tsNow() has to be called at least once per counter wrap, a virtual
+ * timer makes sure of that
+ */
+#define TS_REFRESH              S2ST(10)
+
+/*
+ * raw 32 bit counter, for intervals shorter than 25 s
+ */
+#define tsCycles()              ((uint32_t)DWT_CYCCNT)
+
+/*
+ * TS_START(t) ... TS_ELAPSED(t) measures an interval in cycles
+ */
+#define TS_START(t)             uint32_t t = tsCycles()
+#define TS_ELAPSED(t)           ((uint32_t)(tsCycles() - (t)))
+
+/*
+ * Conversions, the cycle count must not overflow when multiplied by 1000
+ */
+#define TS_CYCLES_PER_US        (TS_FREQUENCY / 1000000)
+#define TS_CYCLES_TO_US(c)      ((c) / TS_CYCLES_PER_US)
+#define TS_CYCLES_TO_NS(c)      ((c) * 1000 / TS_CYCLES_PER_US)
+#define TS_US_TO_CYCLES(us)     ((us) * TS_CYCLES_PER_US)
+#define TS_TICKS_TO_CYCLES(t)   ((uint64_t)(t) * (TS_FREQUENCY / CH_FREQUENCY))
+
+/*
+ * Time between successive calls of tsPeriodUpdate, e.g. of a callback
+ */
+typedef struct {
+  const char *name;
+  tstamp_t last;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+} TsPeriod;
+
+/*
+ * Periods that the ts command can show
+ */
+#define TS_MAX_PERIODS          4
+
+void tsInit(void);
+tstamp_t tsNow(void);
+uint64_t tsToUs(tstamp_t t);
+uint32_t tsToMs(tstamp_t t);
+void tsPeriodUpdate(TsPeriod *tp);
+void tsWatch(TsPeriod *tp, const char *name);
+
+void cmd_ts(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYTIME_H_INCLUDED
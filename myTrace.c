@@ -0,0 +1,166 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "myTrace.h"
+#include "myTime.h"
+
+
+typedef struct {
+  tstamp_t time;
+  uint32_t arg;
+  uint8_t kind;
+  uint8_t info;
+} TraceEvent;
+
+typedef struct {
+  uint8_t irq;
+  const char *name;
+} TraceIrq;
+
+static TraceEvent traceRing[TRACE_EVENTS];
+static unsigned traceHead;              /* next slot to write               */
+static unsigned traceCount;
+static bool_t traceFrozen;              /* while a dump is running          */
+
+static TraceIrq traceIrqs[TRACE_MAX_IRQS];
+static unsigned traceIrqCount;
+
+/*
+ * Called with the kernel locked or from an interrupt, interrupts above
+ * the kernel priority may record too, hence PRIMASK
+ */
+static void traceRecord(tstamp_t time, uint32_t arg, uint8_t kind, uint8_t info) {
+  uint32_t primask = __get_PRIMASK();
+  TraceEvent *ev;
+
+  __disable_irq();
+  if (!traceFrozen) {
+    ev = &traceRing[traceHead];
+    ev->time = time;
+    ev->arg = arg;
+    ev->kind = kind;
+    ev->info = info;
+    traceHead = (traceHead + 1) % TRACE_EVENTS;
+    if (traceCount < TRACE_EVENTS)
+      traceCount++;
+  }
+  __set_PRIMASK(primask);
+}
+
+/*
+ * THREAD_CONTEXT_SWITCH_HOOK, the old thread's state is already set
+ */
+void traceSwitch(void *ntp, void *otp) {
+
+  traceRecord(tsNow(), (uint32_t)ntp, TRACE_KIND_SWITCH,
+              ((Thread *)otp)->p_state);
+}
+
+/*
+ * Records an interrupt that has just taken the given number of cycles
+ */
+void traceIrq(uint8_t irq, uint32_t cycles) {
+
+  traceRecord(tsNow() - cycles, cycles, TRACE_KIND_IRQ, irq);
+}
+
+/*
+ * Gives an interrupt a name in the dump
+ */
+void traceWatchIrq(uint8_t irq, const char *name) {
+
+  if (traceIrqCount < TRACE_MAX_IRQS) {
+    traceIrqs[traceIrqCount].irq = irq;
+    traceIrqs[traceIrqCount].name = name;
+    traceIrqCount++;
+  }
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static void putName(uint8_t *p, const char *name) {
+
+  memset(p, 0, TRACE_NAME_SIZE);
+  if (name)
+    strncpy((char *)p, name, TRACE_NAME_SIZE - 1);
+}
+
+/*
+ * Writes "TRACE <bytes>", the binary dump and "TRACE END".
+ * Recording pauses during the dump and the ring is empty afterwards.
+ */
+void cmd_trace(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint8_t buf[TRACE_THREAD_SIZE];
+  Thread *threads[TRACE_MAX_THREADS];
+  unsigned n = 0, i, first;
+  Thread *tp;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: trace\r\n");
+    return;
+  }
+
+  chSysLock();
+  traceFrozen = TRUE;
+  chSysUnlock();
+
+  /* names are looked up now, threads that have terminated stay anonymous */
+  tp = chRegFirstThread();
+  do {
+    if (n < TRACE_MAX_THREADS)
+      threads[n++] = tp;
+    tp = chRegNextThread(tp);
+  } while (tp != NULL);
+
+  chprintf(chp, "TRACE %U\r\n", TRACE_HEADER_SIZE + n * TRACE_THREAD_SIZE +
+           traceIrqCount * TRACE_IRQ_SIZE + traceCount * TRACE_EVENT_SIZE);
+  put32(buf, TRACE_MAGIC);
+  put32(buf + 4, TS_FREQUENCY);
+  put32(buf + 8, n);
+  put32(buf + 12, traceIrqCount);
+  put32(buf + 16, traceCount);
+  chSequentialStreamWrite(chp, buf, TRACE_HEADER_SIZE);
+
+  for (i = 0; i < n; i++) {
+    put32(buf, (uint32_t)threads[i]);
+    put32(buf + 4, threads[i]->p_prio);
+    putName(buf + 8, threads[i]->p_name);
+    chSequentialStreamWrite(chp, buf, TRACE_THREAD_SIZE);
+  }
+
+  for (i = 0; i < traceIrqCount; i++) {
+    put32(buf, traceIrqs[i].irq);
+    putName(buf + 4, traceIrqs[i].name);
+    chSequentialStreamWrite(chp, buf, TRACE_IRQ_SIZE);
+  }
+
+  first = (traceHead + TRACE_EVENTS - traceCount) % TRACE_EVENTS;
+  for (i = 0; i < traceCount; i++) {
+    const TraceEvent *ev = &traceRing[(first + i) % TRACE_EVENTS];
+    put32(buf, (uint32_t)ev->time);
+    put32(buf + 4, (uint32_t)(ev->time >> 32));
+    put32(buf + 8, ev->arg);
+    buf[12] = ev->kind;
+    buf[13] = ev->info;
+    buf[14] = 0;
+    buf[15] = 0;
+    chSequentialStreamWrite(chp, buf, TRACE_EVENT_SIZE);
+  }
+  chprintf(chp, "\r\nTRACE END\r\n");
+
+  chSysLock();
+  traceHead = 0;
+  traceCount = 0;
+  traceFrozen = FALSE;
+  chSysUnlock();
+}
@@ -0,0 +1,33 @@
+#ifndef MYTRACE_H_INCLUDED
+#define MYTRACE_H_INCLUDED
+
+/*
+ * Context switch and interrupt trace with cycle counter timestamps.
+ * The kernel's own trace (CH_DBG_ENABLE_TRACE) only has system tick
+ * resolution, so THREAD_CONTEXT_SWITCH_HOOK in chconf.h feeds this ring
+ * instead. The interrupt callbacks timed by the load monitor are recorded
+ * too, as spans of their interrupt.
+ * host/trace2json turns a dump into Chrome trace event JSON, the dump
+ * format is in myTraceProto.h.
+ */
+
+#include "myTraceProto.h"
+
+/*
+ * Events in the ring, the oldest ones get overwritten
+ */
+#define TRACE_EVENTS            256
+
+/*
+ * Threads and interrupts that can be named in the dump
+ */
+#define TRACE_MAX_THREADS       12
+#define TRACE_MAX_IRQS          4
+
+void traceSwitch(void *ntp, void *otp);
+void traceIrq(uint8_t irq, uint32_t cycles);
+void traceWatchIrq(uint8_t irq, const char *name);
+
+void cmd_trace(BaseSequentialStream *chp, int argc, char *argv[]);
+
+#endif // MYTRACE_H_INCLUDED
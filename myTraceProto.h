@@ -0,0 +1,30 @@
+#ifndef MYTRACEPROTO_H_INCLUDED
+#define MYTRACEPROTO_H_INCLUDED
+
+/*
+ * Dump format of the trace console command.
+ * Plain C without ChibiOS dependencies, host/trace2json.c builds against
+ * this very file.
+ *
+ * All little endian:
+ *   header  magic u32, frequency u32, thread count u32, irq count u32,
+ *           event count u32
+ *   thread  address u32, prio u32, name 16 bytes zero padded
+ *   irq     number u32, name 16 bytes zero padded
+ *   event   time u64 in cycles, arg u32, kind u8, info u8, 2 bytes padding
+ * A switch event has the new thread in arg and the state the old one was
+ * left in as info, an interrupt event starts at time, lasts arg cycles and
+ * has its number in info.
+ */
+
+#define TRACE_MAGIC             0x31435254      /* "TRC1"                   */
+#define TRACE_NAME_SIZE         16
+#define TRACE_HEADER_SIZE       20
+#define TRACE_THREAD_SIZE       (8 + TRACE_NAME_SIZE)
+#define TRACE_IRQ_SIZE          (4 + TRACE_NAME_SIZE)
+#define TRACE_EVENT_SIZE        16
+
+#define TRACE_KIND_SWITCH       0
+#define TRACE_KIND_IRQ          1
+
+#endif // MYTRACEPROTO_H_INCLUDED
@@ -4,9 +4,29 @@
 #include "hal.h"
 #include "usb_cdc.h"
 #include "shell.h"
+#include "chprintf.h"
 
 #include "myUSB.h"
+#include "myAudio.h"
+#include "myData.h"
+#include "myTime.h"
+#include "myLoad.h"
+#include "myRec.h"
 #include "usbdescriptor.h"
+
+/*
+ * Audio and the data channel both live on EP3, the console's OUT endpoint
+ * then shares EP1 with its IN endpoint
+ */
+#define CDC_OUT_ON_EP1  (MY_USE_USB_AUDIO || MY_USE_DATA_CHANNEL)
+
+#if MY_USE_USB_AUDIO && MY_USE_DATA_CHANNEL
+#error "USB audio and the data channel both need EP3, enable only one of them"
+#endif
+
+#if CDC_OUT_ON_EP1 && USB_CDC_DATA_AVAILABLE_EP != 1
+#error "USB audio and the data channel need USB_CDC_DATA_AVAILABLE_EP=1"
+#endif
 /*
  * Don't ask me, I have no idea what is done here...
  * I think most things are either self explanatory, well documented or not to be touched
@@ -16,6 +36,18 @@
  * USB Driver structure.
  */
 SerialUSBDriver SDU1;
+
+/*
+ * Broadcasts the USB_FLAG_* flags to whoever manages the shell
+ */
+EventSource usbEvents;
+
+/*
+ * Enumeration timing, in cycles since boot
+ */
+static tstamp_t firstConfigured, lastConfigured;
+static tstamp_t firstShell, lastShell;
+static uint32_t configurations;
 
 
 /*===========================================================================*/
@@ -48,18 +80,56 @@ static const USBDescriptor *get_descriptor(USBDriver *usbp,
   return NULL;
 }
 
+/*
+ * The serial driver's endpoint callbacks, timed for the load monitor
+ */
+static void serial_transmitted(USBDriver *usbp, usbep_t ep) {
+  TS_START(start);
+
+  sduDataTransmitted(usbp, ep);
+  loadIrq(LOAD_IRQ_USB, TS_ELAPSED(start));
+}
+
+static void serial_received(USBDriver *usbp, usbep_t ep) {
+  TS_START(start);
+
+  sduDataReceived(usbp, ep);
+  loadIrq(LOAD_IRQ_USB, TS_ELAPSED(start));
+}
+
 /**
  * @brief   IN EP1 state.
  */
 static USBInEndpointState ep1instate;
 
+#if CDC_OUT_ON_EP1
+/**
+ * @brief   OUT EP1 state.
+ */
+static USBOutEndpointState ep1outstate;
+
+/**
+ * @brief   EP1 initialization structure (both IN and OUT).
+ */
+static const USBEndpointConfig ep1config = {
+  USB_EP_MODE_TYPE_BULK,
+  NULL,
+  serial_transmitted,
+  serial_received,
+  0x0040,
+  0x0040,
+  &ep1instate,
+  &ep1outstate,
+  NULL
+};
+#else
 /**
  * @brief   EP1 initialization structure (IN only).
  */
 static const USBEndpointConfig ep1config = {
   USB_EP_MODE_TYPE_BULK,
   NULL,
-  sduDataTransmitted,
+  serial_transmitted,
   NULL,
   0x0040,
   0x0000,
@@ -67,6 +137,7 @@ static const USBEndpointConfig ep1config = {
   NULL,
   NULL
 };
+#endif
 
 /**
  * @brief   OUT EP2 state.
@@ -88,6 +159,7 @@ static const USBEndpointConfig ep2config = {
   NULL
 };
 
+#if !CDC_OUT_ON_EP1
 /**
  * @brief   OUT EP2 state.
  */
@@ -100,21 +172,39 @@ static const USBEndpointConfig ep3config = {
   USB_EP_MODE_TYPE_BULK,
   NULL,
   NULL,
-  sduDataReceived,
+  serial_received,
   0x0000,
   0x0040,
   NULL,
   &ep3outstate,
   NULL
 };
+#endif
+
+/*
+ * Wakes up a shell waiting for input, it reads an end of file and logs out
+ */
+static void usb_disconnectI(flagsmask_t flags) {
+
+  chIQResetI(&SDU1.iqueue);
+  chOQResetI(&SDU1.oqueue);
+#if MY_USE_DATA_CHANNEL
+  dataResetI(&DCH1);
+#endif
+  chEvtBroadcastFlagsI(&usbEvents, flags);
+}
 
 /*
  * Handles the USB driver global events.
  */
-static void usb_event(USBDriver *usbp, usbevent_t event) {
+static void usb_event_handle(USBDriver *usbp, usbevent_t event) {
 
+  recLog(REC_EV_USB, event, 0);
   switch (event) {
   case USB_EVENT_RESET:
+    chSysLockFromIsr();
+    usb_disconnectI(USB_FLAG_RESET);
+    chSysUnlockFromIsr();
     return;
   case USB_EVENT_ADDRESS:
     return;
@@ -126,23 +216,71 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
        must be used.*/
     usbInitEndpointI(usbp, USB_CDC_DATA_REQUEST_EP, &ep1config);
     usbInitEndpointI(usbp, USB_CDC_INTERRUPT_REQUEST_EP, &ep2config);
+#if MY_USE_USB_AUDIO
+    audioConfigureHookI(usbp);
+#elif MY_USE_DATA_CHANNEL
+    dataConfigureHookI(usbp);
+#else
     usbInitEndpointI(usbp, USB_CDC_DATA_AVAILABLE_EP, &ep3config);
+#endif
 
     /* Resetting the state of the CDC subsystem.*/
     sduConfigureHookI(usbp);
 
+    lastConfigured = tsNow();
+    if (configurations++ == 0)
+      firstConfigured = lastConfigured;
+    chEvtBroadcastFlagsI(&usbEvents, USB_FLAG_CONFIGURED);
+
     chSysUnlockFromIsr();
     return;
   case USB_EVENT_SUSPEND:
+    chSysLockFromIsr();
+    usb_disconnectI(USB_FLAG_SUSPEND);
+    chSysUnlockFromIsr();
     return;
   case USB_EVENT_WAKEUP:
+    chSysLockFromIsr();
+    chEvtBroadcastFlagsI(&usbEvents, USB_FLAG_WAKEUP);
+    chSysUnlockFromIsr();
     return;
   case USB_EVENT_STALLED:
     return;
   }
   return;
 }
-
+
+/*
+ * Timed for the load monitor like the endpoint callbacks
+ */
+static void usb_event(USBDriver *usbp, usbevent_t event) {
+  TS_START(start);
+
+  usb_event_handle(usbp, event);
+  loadIrq(LOAD_IRQ_USB, TS_ELAPSED(start));
+}
+
+#if MY_USE_USB_AUDIO
+/*
+ * Start of frame, timed like the other callbacks
+ */
+static void sof_hook(USBDriver *usbp) {
+  TS_START(start);
+
+  audioSofHook(usbp);
+  loadIrq(LOAD_IRQ_USB, TS_ELAPSED(start));
+}
+
+/*
+ * Requests for the audio interfaces are handled first, the rest goes to CDC
+ */
+static bool_t requests_hook(USBDriver *usbp) {
+
+  if (audioRequestsHook(usbp))
+    return TRUE;
+  return sduRequestsHook(usbp);
+}
+#endif
 
 /*
  * Serial over USB driver configuration.
@@ -152,8 +290,13 @@ static const SerialUSBConfig serusbcfg = {
   {
     usb_event,
     get_descriptor,
+#if MY_USE_USB_AUDIO
+    requests_hook,
+    sof_hook
+#else
     sduRequestsHook,
     NULL
+#endif
   }
 };
 
@@ -162,10 +305,41 @@ int isUsbActive(void){
 }
 
 
+/*
+ * Called by main whenever it starts a shell, for the boot statistics
+ */
+void usbShellStarted(void){
+  lastShell = tsNow();
+  if (firstShell == 0)
+    firstShell = lastShell;
+}
+
+/*
+ * prints how long enumeration and the first/last shell took
+ */
+void cmd_boot(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: boot\r\n");
+    return;
+  }
+  chprintf(chp, "configurations      : %U\r\n", configurations);
+  chprintf(chp, "boot to configured  : %U us\r\n", (uint32_t)tsToUs(firstConfigured));
+  chprintf(chp, "boot to prompt      : %U us\r\n", (uint32_t)tsToUs(firstShell));
+  if (lastShell >= lastConfigured)
+    chprintf(chp, "configured to prompt: %U us (last time)\r\n",
+             (uint32_t)tsToUs(lastShell - lastConfigured));
+}
+
 void myUSBinit(void){
+  chEvtInit(&usbEvents);
   usbDisconnectBus(serusbcfg.usbp);
-  chThdSleepMilliseconds(1000);
+  chThdSleepMilliseconds(USB_DISCONNECT_DELAY);
   sduObjectInit(&SDU1);
+#if MY_USE_DATA_CHANNEL
+  dataObjectInit(&DCH1, serusbcfg.usbp);
+#endif
   sduStart(&SDU1, &serusbcfg);  // => usbStart(config->usbp, &config->usb_config);
   usbConnectBus(serusbcfg.usbp);
 
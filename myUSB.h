@@ -1,8 +1,24 @@
 #ifndef MYUSB_H_INCLUDED
 #define MYUSB_H_INCLUDED
 extern SerialUSBDriver SDU1;
+
+/*
+ * Flags broadcast on usbEvents from the USB event callback
+ */
+#define USB_FLAG_CONFIGURED     1
+#define USB_FLAG_RESET          2
+#define USB_FLAG_SUSPEND        4
+#define USB_FLAG_WAKEUP         8
+extern EventSource usbEvents;
+
+/*
+ * Time the bus stays disconnected so the host notices a restart [ms]
+ */
+#define USB_DISCONNECT_DELAY    100
 
 void myUSBinit(void);
 int isUsbActive(void);
+void usbShellStarted(void);
+void cmd_boot(BaseSequentialStream *chp, int argc, char *argv[]);
 
 #endif // MYUSB_H_INCLUDED
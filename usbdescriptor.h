@@ -2,14 +2,42 @@
 #define USBDESCRIPTOR_H_INCLUDED
 
 #include "usb_cdc.h"
+
+#if MY_USE_USB_AUDIO
+/*
+ * CDC (interfaces 0 and 1) grouped by an IAD, followed by the audio
+ * control (2) and audio streaming (3) interfaces.
+ */
+#define VCOM_NUM_INTERFACES     4
+#define VCOM_CONFIG_SIZE        (67 + 8 + 91)
+#elif MY_USE_DATA_CHANNEL
+/*
+ * CDC (interfaces 0 and 1) grouped by an IAD, followed by the vendor
+ * specific data interface (2). The OTG FS core has only three IN endpoints,
+ * so there is no room for the interrupt endpoint a second ACM would need.
+ */
+#define VCOM_NUM_INTERFACES     3
+#define VCOM_CONFIG_SIZE        (67 + 8 + 23)
+#else
+#define VCOM_NUM_INTERFACES     2
+#define VCOM_CONFIG_SIZE        67
+#endif
+
 /*
  * USB Device Descriptor.
  */
 static const uint8_t vcom_device_descriptor_data[18] = {
+#if MY_USE_USB_AUDIO || MY_USE_DATA_CHANNEL
+  USB_DESC_DEVICE       (0x0110,        /* bcdUSB (1.1).                    */
+                         0xEF,          /* bDeviceClass (Miscellaneous).    */
+                         0x02,          /* bDeviceSubClass (Common Class).  */
+                         0x01,          /* bDeviceProtocol (IAD).           */
+#else
   USB_DESC_DEVICE       (0x0110,        /* bcdUSB (1.1).                    */
                          0x02,          /* bDeviceClass (CDC).              */
                          0x00,          /* bDeviceSubClass.                 */
                          0x00,          /* bDeviceProtocol.                 */
+#endif
                          0x40,          /* bMaxPacketSize.                  */
                          0x0483,        /* idVendor (ST).                   */
                          0x5740,        /* idProduct.                       */
@@ -29,14 +57,25 @@ static const USBDescriptor vcom_device_descriptor = {
 };
 
 /* Configuration Descriptor tree for a CDC.*/
-static const uint8_t vcom_configuration_descriptor_data[67] = {
+static const uint8_t vcom_configuration_descriptor_data[VCOM_CONFIG_SIZE] = {
   /* Configuration Descriptor.*/
-  USB_DESC_CONFIGURATION(67,            /* wTotalLength.                    */
-                         0x02,          /* bNumInterfaces.                  */
+  USB_DESC_CONFIGURATION(VCOM_CONFIG_SIZE, /* wTotalLength.                 */
+                         VCOM_NUM_INTERFACES, /* bNumInterfaces.            */
                          0x01,          /* bConfigurationValue.             */
                          0,             /* iConfiguration.                  */
                          0xC0,          /* bmAttributes (self powered).     */
                          50),           /* bMaxPower (100mA).               */
+#if MY_USE_USB_AUDIO || MY_USE_DATA_CHANNEL
+  /* Interface Association Descriptor for the CDC function.*/
+  USB_DESC_BYTE         (8),            /* bLength.                         */
+  USB_DESC_BYTE         (0x0B),         /* bDescriptorType (IAD).           */
+  USB_DESC_BYTE         (0x00),         /* bFirstInterface.                 */
+  USB_DESC_BYTE         (0x02),         /* bInterfaceCount.                 */
+  USB_DESC_BYTE         (0x02),         /* bFunctionClass (CDC).            */
+  USB_DESC_BYTE         (0x02),         /* bFunctionSubClass (ACM).         */
+  USB_DESC_BYTE         (0x01),         /* bFunctionProtocol (AT commands). */
+  USB_DESC_BYTE         (0),            /* iFunction.                       */
+#endif
   /* Interface Descriptor.*/
   USB_DESC_INTERFACE    (0x00,          /* bInterfaceNumber.                */
                          0x00,          /* bAlternateSetting.               */
@@ -103,6 +142,124 @@ static const uint8_t vcom_configuration_descriptor_data[67] = {
                          0x02,          /* bmAttributes (Bulk).             */
                          0x0040,        /* wMaxPacketSize.                  */
                          0x00)          /* bInterval.                       */
+#if MY_USE_USB_AUDIO
+  ,
+  /* Audio Control Interface Descriptor (UAC1 section 4.3.1).*/
+  USB_DESC_INTERFACE    (AUDIO_CONTROL_INTERFACE, /* bInterfaceNumber.      */
+                         0x00,          /* bAlternateSetting.               */
+                         0x00,          /* bNumEndpoints.                   */
+                         0x01,          /* bInterfaceClass (Audio).         */
+                         0x01,          /* bInterfaceSubClass (Audio
+                                           Control).                        */
+                         0x00,          /* bInterfaceProtocol.              */
+                         0),            /* iInterface.                      */
+  /* Class-specific AC Interface Header Descriptor (UAC1 section 4.3.2).*/
+  USB_DESC_BYTE         (9),            /* bLength.                         */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x01),         /* bDescriptorSubtype (HEADER).     */
+  USB_DESC_BCD          (0x0100),       /* bcdADC.                          */
+  USB_DESC_WORD         (9 + 12 + 9),   /* wTotalLength (header and
+                                           terminals).                      */
+  USB_DESC_BYTE         (1),            /* bInCollection.                   */
+  USB_DESC_BYTE         (AUDIO_STREAMING_INTERFACE), /* baInterfaceNr(1).   */
+  /* Input Terminal Descriptor (UAC1 section 4.3.2.1).*/
+  USB_DESC_BYTE         (12),           /* bLength.                         */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x02),         /* bDescriptorSubtype
+                                           (INPUT_TERMINAL).                */
+  USB_DESC_BYTE         (1),            /* bTerminalID.                     */
+  USB_DESC_WORD         (0x0201),       /* wTerminalType (Microphone).      */
+  USB_DESC_BYTE         (0),            /* bAssocTerminal.                  */
+  USB_DESC_BYTE         (1),            /* bNrChannels.                     */
+  USB_DESC_WORD         (0x0000),       /* wChannelConfig (mono).           */
+  USB_DESC_BYTE         (0),            /* iChannelNames.                   */
+  USB_DESC_BYTE         (0),            /* iTerminal.                       */
+  /* Output Terminal Descriptor (UAC1 section 4.3.2.2).*/
+  USB_DESC_BYTE         (9),            /* bLength.                         */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x03),         /* bDescriptorSubtype
+                                           (OUTPUT_TERMINAL).               */
+  USB_DESC_BYTE         (2),            /* bTerminalID.                     */
+  USB_DESC_WORD         (0x0101),       /* wTerminalType (USB streaming).   */
+  USB_DESC_BYTE         (0),            /* bAssocTerminal.                  */
+  USB_DESC_BYTE         (1),            /* bSourceID.                       */
+  USB_DESC_BYTE         (0),            /* iTerminal.                       */
+  /* Audio Streaming Interface Descriptor, zero bandwidth setting.*/
+  USB_DESC_INTERFACE    (AUDIO_STREAMING_INTERFACE, /* bInterfaceNumber.    */
+                         0x00,          /* bAlternateSetting.               */
+                         0x00,          /* bNumEndpoints.                   */
+                         0x01,          /* bInterfaceClass (Audio).         */
+                         0x02,          /* bInterfaceSubClass (Audio
+                                           Streaming).                      */
+                         0x00,          /* bInterfaceProtocol.              */
+                         0),            /* iInterface.                      */
+  /* Audio Streaming Interface Descriptor, streaming setting.*/
+  USB_DESC_INTERFACE    (AUDIO_STREAMING_INTERFACE, /* bInterfaceNumber.    */
+                         0x01,          /* bAlternateSetting.               */
+                         0x01,          /* bNumEndpoints.                   */
+                         0x01,          /* bInterfaceClass (Audio).         */
+                         0x02,          /* bInterfaceSubClass (Audio
+                                           Streaming).                      */
+                         0x00,          /* bInterfaceProtocol.              */
+                         0),            /* iInterface.                      */
+  /* Class-specific AS General Interface Descriptor (UAC1 section 4.5.2).*/
+  USB_DESC_BYTE         (7),            /* bLength.                         */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x01),         /* bDescriptorSubtype (AS_GENERAL). */
+  USB_DESC_BYTE         (2),            /* bTerminalLink.                   */
+  USB_DESC_BYTE         (1),            /* bDelay.                          */
+  USB_DESC_WORD         (0x0001),       /* wFormatTag (PCM).                */
+  /* Type I Format Type Descriptor (UAC1 formats section 2.2.5).*/
+  USB_DESC_BYTE         (11),           /* bLength.                         */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x02),         /* bDescriptorSubtype (FORMAT_TYPE).*/
+  USB_DESC_BYTE         (0x01),         /* bFormatType (FORMAT_TYPE_I).     */
+  USB_DESC_BYTE         (1),            /* bNrChannels.                     */
+  USB_DESC_BYTE         (2),            /* bSubframeSize.                   */
+  USB_DESC_BYTE         (16),           /* bBitResolution.                  */
+  USB_DESC_BYTE         (1),            /* bSamFreqType (one discrete).     */
+  USB_DESC_BYTE         (AUDIO_SAMPLE_RATE & 0xFF),         /* tSamFreq.    */
+  USB_DESC_BYTE         ((AUDIO_SAMPLE_RATE >> 8) & 0xFF),
+  USB_DESC_BYTE         ((AUDIO_SAMPLE_RATE >> 16) & 0xFF),
+  /* Standard AS Isochronous Audio Data Endpoint (UAC1 section 4.6.1.1).*/
+  USB_DESC_BYTE         (9),            /* bLength.                         */
+  USB_DESC_BYTE         (0x05),         /* bDescriptorType (ENDPOINT).      */
+  USB_DESC_BYTE         (AUDIO_EP|0x80), /* bEndpointAddress.               */
+  USB_DESC_BYTE         (0x05),         /* bmAttributes (Isochronous,
+                                           asynchronous).                   */
+  USB_DESC_WORD         (AUDIO_PACKET_SIZE), /* wMaxPacketSize.             */
+  USB_DESC_BYTE         (1),            /* bInterval (1 ms).                */
+  USB_DESC_BYTE         (0),            /* bRefresh.                        */
+  USB_DESC_BYTE         (0),            /* bSynchAddress.                   */
+  /* Class-specific Isochronous Audio Data Endpoint (UAC1 4.6.1.2).*/
+  USB_DESC_BYTE         (7),            /* bLength.                         */
+  USB_DESC_BYTE         (0x25),         /* bDescriptorType (CS_ENDPOINT).   */
+  USB_DESC_BYTE         (0x01),         /* bDescriptorSubtype (EP_GENERAL). */
+  USB_DESC_BYTE         (0x00),         /* bmAttributes.                    */
+  USB_DESC_BYTE         (0),            /* bLockDelayUnits.                 */
+  USB_DESC_WORD         (0x0000)        /* wLockDelay.                      */
+#elif MY_USE_DATA_CHANNEL
+  ,
+  /* Interface Descriptor, data channel.*/
+  USB_DESC_INTERFACE    (DATA_INTERFACE, /* bInterfaceNumber.               */
+                         0x00,          /* bAlternateSetting.               */
+                         0x02,          /* bNumEndpoints.                   */
+                         0xFF,          /* bInterfaceClass (Vendor
+                                           specific).                       */
+                         0x00,          /* bInterfaceSubClass.              */
+                         0x00,          /* bInterfaceProtocol.              */
+                         0),            /* iInterface.                      */
+  /* Endpoint 3 Descriptor, OUT.*/
+  USB_DESC_ENDPOINT     (DATA_EP,       /* bEndpointAddress.                */
+                         0x02,          /* bmAttributes (Bulk).             */
+                         0x0040,        /* wMaxPacketSize.                  */
+                         0x00),         /* bInterval.                       */
+  /* Endpoint 3 Descriptor, IN.*/
+  USB_DESC_ENDPOINT     (DATA_EP|0x80,  /* bEndpointAddress.                */
+                         0x02,          /* bmAttributes (Bulk).             */
+                         0x0040,        /* wMaxPacketSize.                  */
+                         0x00)          /* bInterval.                       */
+#endif
 };
 
 /*